@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2025 Rob Scott
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Compare rmii_ethernet_chksum() (src/lwip/chksum.S) with LWIP's C
+// checksum, for speed in cycles per byte and for matching results over
+// random data, lengths and alignments
+
+#include <string.h>
+
+#include "pico/rand.h"
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+
+#include "lwip/opt.h"
+#include "rmii_ethernet/netif.h"
+
+// Checksums per size, enough for a stable microsecond timer reading
+#define BENCH_REPEAT 2000
+
+#define BENCH_MAX 2048
+
+// Random comparisons
+#define CHECK_COUNT 100000
+
+static uint8_t buf[BENCH_MAX + 4] __attribute__((aligned (4)));
+
+typedef uint16_t (*chksum_fn)(const void *dataptr, int len);
+
+// lwip_standard_chksum(), LWIP_CHKSUM_ALGORITHM 2, which isn't built when
+// LWIP_CHKSUM is set
+static uint16_t c_chksum(const void *dataptr, int len) {
+  const uint8_t *pb = (const uint8_t *)dataptr;
+  const uint16_t *ps;
+  uint16_t t = 0;
+  uint32_t sum = 0;
+  int odd = ((uintptr_t)pb & 1);
+
+  if (odd && len > 0) {
+    ((uint8_t *)&t)[1] = *pb++;
+    len--;
+  }
+
+  ps = (const uint16_t *)(const void *)pb;
+  while (len > 1) {
+    sum += *ps++;
+    len -= 2;
+  }
+
+  if (len > 0) {
+    ((uint8_t *)&t)[0] = *(const uint8_t *)ps;
+  }
+
+  sum += t;
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+
+  if (odd) {
+    sum = ((sum & 0xff) << 8) | ((sum & 0xff00) >> 8);
+  }
+
+  return (uint16_t)sum;
+}
+
+// Average checksum time in system clock cycles
+static uint32_t bench(chksum_fn fn, uint offset, uint len) {
+  volatile uint16_t sum;
+  uint64_t start = time_us_64();
+
+  for (uint i = 0; i < BENCH_REPEAT; i++) {
+    sum = fn(&buf[offset], len);
+  }
+
+  uint64_t us = time_us_64() - start;
+  (void)sum;
+
+  return (uint32_t)((us * (clock_get_hz(clk_sys) / 1000000)) / BENCH_REPEAT);
+}
+
+int main() {
+  uint errors = 0;
+
+  // Same clocks and stdio as the network examples
+  arch_pico_init();
+
+  printf("chksum bench, sys clk %u MHz\n",
+	 (uint)(clock_get_hz(clk_sys) / 1000000));
+
+#if RMII_ASM_CHKSUM
+  for (uint i = 0; i < CHECK_COUNT; i++) {
+    uint offset = get_rand_32() & 3;
+    uint len = get_rand_32() % (BENCH_MAX + 1);
+
+    // Runs of 0x00 and 0xff find carry handling mistakes
+    switch (get_rand_32() & 7) {
+    case 0:
+      memset(buf, 0x00, sizeof(buf));
+      break;
+
+    case 1:
+      memset(buf, 0xff, sizeof(buf));
+      break;
+
+    default:
+      for (uint j = 0; j < sizeof(buf); j += 4) {
+	uint32_t r = get_rand_32();
+	memcpy(&buf[j], &r, 4);
+      }
+      break;
+    }
+
+    if (rmii_ethernet_chksum(&buf[offset], len) !=
+	c_chksum(&buf[offset], len)) {
+      if (errors++ < 10) {
+	printf("mismatch, offset %u length %u\n", offset, len);
+      }
+    }
+  }
+
+  printf("%u random checks, %u mismatches\n", CHECK_COUNT, errors);
+
+  printf("  size align      c    asm (cycles, x100 per byte)\n");
+
+  for (uint len = 16; len <= BENCH_MAX; len <<= 1) {
+    for (uint offset = 0; offset < 2; offset++) {
+      uint32_t c = bench(c_chksum, offset, len);
+      uint32_t a = bench(rmii_ethernet_chksum, offset, len);
+
+      printf("%6u %5u %6u %6u    %4u %4u\n", len, offset, (uint)c, (uint)a,
+	     (uint)(c * 100 / len), (uint)(a * 100 / len));
+    }
+  }
+#else
+  printf("RMII_ASM_CHKSUM is off, no assembly checksum for this core\n");
+#endif
+
+  while (1) {
+    tight_loop_contents();
+  }
+
+  return 0;
+}
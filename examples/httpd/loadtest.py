@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# HTTP load test for the httpd example
+#
+# Usage:
+#   loadtest.py [-c connections] [-t seconds] host [path ...]
+#
+# Each connection sends keep-alive GET requests back to back, cycling
+# through the paths, and reads each response by its Content-Length. A
+# connection closed by the server is reopened. Reports requests/s and
+# MB/s of response bodies.
+
+import argparse
+import asyncio
+import time
+
+
+async def worker(host, port, paths, deadline, stats):
+    reader = writer = None
+    i = 0
+
+    while time.monotonic() < deadline:
+        try:
+            if writer is None:
+                reader, writer = await asyncio.open_connection(host, port)
+                stats['connects'] += 1
+
+            path = paths[i % len(paths)]
+            i += 1
+            writer.write(f'GET {path} HTTP/1.1\r\nHost: {host}\r\n'
+                         'Connection: keep-alive\r\n'
+                         'Accept-Encoding: gzip\r\n\r\n'.encode())
+            await writer.drain()
+
+            hdr = await reader.readuntil(b'\r\n\r\n')
+            length = 0
+            keep = True
+            for line in hdr.decode(errors='replace').split('\r\n')[1:]:
+                name, _, value = line.partition(':')
+                name = name.strip().lower()
+                if name == 'content-length':
+                    length = int(value)
+                elif name == 'connection' and 'close' in value.lower():
+                    keep = False
+
+            await reader.readexactly(length)
+            stats['requests'] += 1
+            stats['bytes'] += length
+
+            if not keep:
+                writer.close()
+                writer = None
+        except (OSError, asyncio.IncompleteReadError,
+                asyncio.LimitOverrunError, ValueError):
+            stats['errors'] += 1
+            if writer is not None:
+                writer.close()
+            writer = None
+
+    if writer is not None:
+        writer.close()
+
+
+async def run(args):
+    stats = {'requests': 0, 'bytes': 0, 'connects': 0, 'errors': 0}
+    paths = args.paths or ['/index.html']
+
+    start = time.monotonic()
+    deadline = start + args.time
+    await asyncio.gather(*(worker(args.host, args.port, paths, deadline,
+                                  stats)
+                           for _ in range(args.connections)))
+    elapsed = time.monotonic() - start
+
+    print(f'{stats["requests"]} requests in {elapsed:.1f} s, '
+          f'{args.connections} connections '
+          f'({stats["connects"]} connects, {stats["errors"]} errors)')
+    print(f'{stats["requests"] / elapsed:.1f} requests/s, '
+          f'{stats["bytes"] / elapsed / 1e6:.3f} MB/s')
+
+
+def main():
+    ap = argparse.ArgumentParser(description='HTTP keep-alive load test')
+    ap.add_argument('-c', '--connections', type=int, default=4)
+    ap.add_argument('-t', '--time', type=float, default=10)
+    ap.add_argument('-p', '--port', type=int, default=80)
+    ap.add_argument('host')
+    ap.add_argument('paths', nargs='*')
+    asyncio.run(run(ap.parse_args()))
+
+
+if __name__ == '__main__':
+    main()
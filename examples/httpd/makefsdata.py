@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Pack a content directory into an LWIP httpd fsdata file
+#
+# Usage:
+#   makefsdata.py [--sram] content_dir fsdata_pack.c
+#
+# Each file is stored gzip compressed (unless that doesn't make it smaller,
+# e.g. images), behind a complete HTTP/1.1 response header with
+# Content-Length, so httpd can keep connections alive and send the file
+# straight from the image without copying it. Files are word aligned. With
+# --sram the image is placed in SRAM, otherwise it stays in flash.
+#
+# Select the generated file with HTTPD_FSDATA_FILE, see CMakeLists.txt.
+
+import argparse
+import gzip
+import os
+import re
+
+# Header flags, from lwip/apps/fs.h
+FS_FILE_FLAGS_HEADER_INCLUDED = 0x01
+FS_FILE_FLAGS_HEADER_PERSISTENT = 0x02
+FS_FILE_FLAGS_HEADER_HTTPVER_1_1 = 0x04
+
+CONTENT_TYPES = {
+    '.html': 'text/html',
+    '.htm': 'text/html',
+    '.css': 'text/css',
+    '.js': 'application/javascript',
+    '.json': 'application/json',
+    '.svg': 'image/svg+xml',
+    '.txt': 'text/plain',
+    '.xml': 'text/xml',
+    '.png': 'image/png',
+    '.jpg': 'image/jpeg',
+    '.jpeg': 'image/jpeg',
+    '.gif': 'image/gif',
+    '.ico': 'image/x-icon',
+}
+
+NOT_FOUND = b'<html><body><h1>404 Not Found</h1></body></html>\n'
+
+
+def response(path, body):
+    ext = os.path.splitext(path)[1].lower()
+    ctype = CONTENT_TYPES.get(ext, 'application/octet-stream')
+
+    # httpd picks the status line from the 404 file name, like makefsdata
+    status = '404 Not Found' if os.path.basename(path).startswith('404') \
+        else '200 OK'
+
+    packed = gzip.compress(body, compresslevel=9, mtime=0)
+    hdr = [f'HTTP/1.1 {status}',
+           'Server: lwIP/pico-rmii-ethernet',
+           f'Content-Type: {ctype}']
+    if len(packed) < len(body):
+        hdr.append('Content-Encoding: gzip')
+        body = packed
+    hdr.append(f'Content-Length: {len(body)}')
+
+    return ('\r\n'.join(hdr) + '\r\n\r\n').encode() + body, len(body)
+
+
+def c_ident(path):
+    return 'file_' + re.sub(r'[^A-Za-z0-9]', '_', path)
+
+
+def c_bytes(data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append('  ' + ','.join(f'0x{b:02x}' for b in data[i:i + 16]) + ',')
+    return '\n'.join(lines)
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description='Pack a content directory into an LWIP fsdata file')
+    ap.add_argument('--sram', action='store_true',
+                    help='place the image in SRAM instead of flash')
+    ap.add_argument('content')
+    ap.add_argument('output')
+    args = ap.parse_args()
+
+    files = {}
+    for root, _, names in os.walk(args.content):
+        for name in sorted(names):
+            full = os.path.join(root, name)
+            rel = '/' + os.path.relpath(full, args.content).replace(os.sep, '/')
+            with open(full, 'rb') as f:
+                files[rel] = f.read()
+
+    if '/404.html' not in files:
+        files['/404.html'] = NOT_FOUND
+
+    # Flash images stay const, SRAM images are writable data, copied to
+    # SRAM at boot
+    storage = 'static' if args.sram else 'static const'
+    flags = (FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT |
+             FS_FILE_FLAGS_HEADER_HTTPVER_1_1)
+
+    out = ['// Generated by makefsdata.py, do not edit',
+           '',
+           '#include "lwip/apps/fs.h"',
+           '#include "lwip/def.h"',
+           '']
+
+    total = 0
+    prev = 'NULL'
+    for path in sorted(files):
+        data, body_len = response(path, files[path])
+        total += len(data)
+        ident = c_ident(path)
+
+        out.append(f'// {path}: {len(files[path])} bytes, {body_len} sent')
+        out.append(f'static const unsigned char {ident}_name[] = "{path}";')
+        out.append(f'{storage} unsigned char {ident}_data[] '
+                   '__attribute__((aligned (4))) = {')
+        out.append(c_bytes(data))
+        out.append('};')
+        out.append(f'static const struct fsdata_file {ident}[] = {{{{')
+        out.append(f'  {prev},')
+        out.append(f'  {ident}_name,')
+        out.append(f'  {ident}_data,')
+        out.append(f'  sizeof({ident}_data),')
+        out.append(f'  0x{flags:02x},')
+        out.append('}};')
+        out.append('')
+        prev = ident
+
+    out.append(f'#define FS_ROOT {prev}')
+    out.append(f'#define FS_NUMFILES {len(files)}')
+    out.append(f'// {total} bytes in {"SRAM" if args.sram else "flash"}')
+    out.append('')
+
+    with open(args.output, 'w') as f:
+        f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
@@ -6,6 +6,7 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
+#include "pico/flash.h"
 #include "pico/multicore.h"
 #include "pico/stdlib.h"
 
@@ -53,8 +54,8 @@ int main() {
   netif_set_default(&netif);
   netif_set_up(&netif);
 
-  // Start DHCP client and iperf
-  dhcp_start(&netif);
+  // Start DHCP client, resuming the lease saved in flash, and iperf
+  netif_rmii_ethernet_dhcp_resume(&netif);
 
   iperf_init();
 
@@ -62,6 +63,9 @@ int main() {
   // This allows core 0 do other things :)
   multicore_launch_core1(netif_rmii_ethernet_loop);
 
+  // Let core 1 hold this core off while it saves the lease to flash
+  flash_safe_execute_core_init();
+
   while (1) {
     tight_loop_contents();
   }
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2025 Rob Scott
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Find the copy size above which rmii_ethernet_memcpy_dma() beats the
+// CPU memcpy(), for setting RMII_DMA_MEMCPY_MIN in lwipopts.h
+
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+
+#include "lwip/opt.h"
+#include "rmii_ethernet/netif.h"
+
+// Copies per size, enough for a stable microsecond timer reading
+#define BENCH_REPEAT 2000
+
+#define BENCH_MAX 2048
+
+static uint8_t src_buf[BENCH_MAX] __attribute__((aligned (4)));
+static uint8_t dst_buf[BENCH_MAX] __attribute__((aligned (4)));
+
+typedef void *(*copy_fn)(void *dst, const void *src, size_t len);
+
+// Average copy time in system clock cycles
+static uint32_t bench(copy_fn fn, uint len) {
+  uint64_t start = time_us_64();
+
+  for (uint i = 0; i < BENCH_REPEAT; i++) {
+    fn(dst_buf, src_buf, len);
+  }
+
+  uint64_t us = time_us_64() - start;
+
+  return (uint32_t)((us * (clock_get_hz(clk_sys) / 1000000)) / BENCH_REPEAT);
+}
+
+int main() {
+  uint crossover = 0;
+
+  // Same clocks and stdio as the network examples
+  arch_pico_init();
+
+  for (uint i = 0; i < BENCH_MAX; i++) {
+    src_buf[i] = i;
+  }
+
+  printf("memcpy bench, sys clk %u MHz\n",
+	 (uint)(clock_get_hz(clk_sys) / 1000000));
+  printf("  size    cpu    dma (cycles)\n");
+
+  for (uint len = 16; len <= BENCH_MAX; len <<= 1) {
+    uint32_t cpu = bench(memcpy, len);
+    uint32_t dma = bench(rmii_ethernet_memcpy_dma, len);
+
+    if (memcmp(dst_buf, src_buf, len) != 0) {
+      printf("copy mismatch at size %u\n", len);
+    }
+
+    printf("%6u %6u %6u\n", len, (uint)cpu, (uint)dma);
+
+    if ((crossover == 0) && (dma < cpu)) crossover = len;
+  }
+
+  printf("DMA faster from %u bytes, RMII_DMA_MEMCPY_MIN is %u\n",
+	 crossover, RMII_DMA_MEMCPY_MIN);
+
+  while (1) {
+    tight_loop_contents();
+  }
+
+  return 0;
+}
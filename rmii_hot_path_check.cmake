@@ -0,0 +1,42 @@
+# Post-link check that the per-packet code path is in SRAM
+# Invoked by pico_rmii_ethernet_check_hot_path() as:
+#   cmake -DNM=<nm> -DELF=<elf> -DSYMBOLS=<list> -P rmii_hot_path_check.cmake
+
+execute_process(COMMAND ${NM} ${ELF}
+  OUTPUT_VARIABLE NM_OUT
+  RESULT_VARIABLE NM_RESULT
+)
+
+if(NOT NM_RESULT EQUAL 0)
+  message(FATAL_ERROR "Unable to read symbols from ${ELF}")
+endif()
+
+set(IN_FLASH "")
+
+foreach(SYM ${SYMBOLS})
+  # The function and any GCC clones of it (.isra.0, .constprop.0 ...)
+  string(REGEX MATCHALL "[0-9a-fA-F]+ [tTwW] ${SYM}(\\.[a-z]+\\.[0-9]+)*\n"
+    MATCHED "${NM_OUT}")
+
+  if(NOT MATCHED)
+    # Not linked in, or inlined into its caller
+    message(STATUS "Hot path symbol ${SYM} not found")
+    continue()
+  endif()
+
+  foreach(LINE ${MATCHED})
+    string(REGEX MATCH "^([0-9a-fA-F]+) [tTwW] ([^\n]+)" LINE "${LINE}")
+    set(ADDR ${CMAKE_MATCH_1})
+    set(NAME ${CMAKE_MATCH_2})
+
+    # XIP flash is mapped at 0x10000000, SRAM at 0x20000000
+    if(ADDR MATCHES "^1.......$")
+      list(APPEND IN_FLASH "${NAME} (0x${ADDR})")
+    endif()
+  endforeach()
+endforeach()
+
+if(IN_FLASH)
+  string(REPLACE ";" "\n  " IN_FLASH "${IN_FLASH}")
+  message(FATAL_ERROR "Hot path symbols located in flash:\n  ${IN_FLASH}")
+endif()
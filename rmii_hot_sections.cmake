@@ -0,0 +1,45 @@
+# Move the hot path functions of a library to SRAM
+# Invoked after pico_rmii_ethernet_hot is built as:
+#   cmake -DOBJCOPY=<objcopy> -DOBJDUMP=<objdump> -DLIB=<lib>
+#         -DSYMBOLS=<list> -P rmii_hot_sections.cmake
+#
+# Each function is in its own .text.<name> section. GCC clones of a function
+# (.isra.0, .constprop.0, .part.0 ...) get sections of their own, so the
+# sections are read back from the library rather than named from the list.
+
+execute_process(COMMAND ${OBJDUMP} -h ${LIB}
+  OUTPUT_VARIABLE OBJDUMP_OUT
+  RESULT_VARIABLE OBJDUMP_RESULT
+)
+
+if(NOT OBJDUMP_RESULT EQUAL 0)
+  message(FATAL_ERROR "Unable to read sections from ${LIB}")
+endif()
+
+string(REGEX MATCHALL "\\.text\\.[^ \t\n]+" SECTIONS "${OBJDUMP_OUT}")
+list(REMOVE_DUPLICATES SECTIONS)
+
+set(RENAMES "")
+
+foreach(SECTION ${SECTIONS})
+  string(REGEX REPLACE "^\\.text\\." "" NAME "${SECTION}")
+
+  # Function name without any clone suffixes
+  string(REGEX REPLACE "\\..*$" "" BASE "${NAME}")
+
+  list(FIND SYMBOLS "${BASE}" INDEX)
+
+  if(NOT INDEX EQUAL -1)
+    list(APPEND RENAMES --rename-section ${SECTION}=.time_critical.${NAME})
+  endif()
+endforeach()
+
+if(RENAMES)
+  execute_process(COMMAND ${OBJCOPY} ${RENAMES} ${LIB}
+    RESULT_VARIABLE OBJCOPY_RESULT
+  )
+
+  if(NOT OBJCOPY_RESULT EQUAL 0)
+    message(FATAL_ERROR "Unable to move hot path sections in ${LIB}")
+  endif()
+endif()
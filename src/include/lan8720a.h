@@ -17,4 +17,5 @@
 #define LAN8720A_AUTO_NEGO_REG_10_ABI        (1 << 5)
 #define LAN8720A_AUTO_NEGO_REG_10_FD_ABI     (1 << 6)
 #define LAN8720A_AUTO_NEGO_REG_100_ABI       (1 << 7)
-#define LAN8720A_AUTO_NEGO_REG_100_FD_ABI    (1 << 8)
\ No newline at end of file
+#define LAN8720A_AUTO_NEGO_REG_100_FD_ABI    (1 << 8)
+#define LAN8720A_AUTO_NEGO_REG_SYM_PAUSE     (1 << 10)
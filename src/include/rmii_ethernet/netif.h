@@ -22,5 +22,143 @@ void netif_rmii_ethernet_loop();
 uint16_t netif_rmii_ethernet_mdio_read(uint addr, uint reg);
 void netif_rmii_ethernet_mdio_write(uint addr, uint reg, uint val);
 
+// TX priority queues (USE_TX_PRIORITY)
+// Classifier returns a traffic class, 0 lowest, or -1 for the default
+// PCP/DSCP based classification
+typedef int (*netif_rmii_ethernet_tx_class_fn)(struct pbuf *p);
+void netif_rmii_ethernet_tx_set_classifier(netif_rmii_ethernet_tx_class_fn fn);
+
+// Token bucket shaper for a traffic class, rate in bytes/sec, 0 disables
+void netif_rmii_ethernet_tx_set_shaper(uint cls, uint32_t rate,
+				       uint32_t burst);
+
+// Raw Ethernet frames for custom EtherTypes, bypassing LWIP
+// The handler gets a read-only view of the frame in the RX ring, without
+// the FCS, split in two where the ring wraps (len2 is 0 otherwise). The
+// view is only valid during the call, from netif_rmii_ethernet_poll().
+typedef void (*netif_rmii_ethernet_raw_fn)(const uint8_t *data1, uint len1,
+					   const uint8_t *data2, uint len2,
+					   void *arg);
+
+// Set the handler for an EtherType, NULL removes it
+// Returns false if the handler table is full
+bool netif_rmii_ethernet_set_raw_handler(uint16_t type,
+					 netif_rmii_ethernet_raw_fn fn,
+					 void *arg);
+
+// Send a frame, destination MAC through payload, without FCS
+// Call from the same core as netif_rmii_ethernet_poll()
+err_t netif_rmii_ethernet_send_raw(const void *frame, uint len);
+
+// UDP stream, a prebuilt Ethernet/IPv4/UDP header for sending datagrams
+// straight into the TX ring
+typedef struct {
+  uint8_t hdr[ETH_PAD_SIZE + 42];  // Header template, LWIP padding in front
+  uint32_t ip_sum;                 // IPv4 header sum, without length and ID
+  uint32_t udp_sum;                // Pseudo header and port sum, no length
+  uint16_t ip_id;
+} netif_rmii_ethernet_udp_stream_t;
+
+// Build the header template for a destination, resolving its MAC address
+// Returns ERR_INPROGRESS while waiting for ARP, call again until ERR_OK.
+// Returns ERR_CONN if the interface has no address yet, ERR_RTE if dst is
+// off the subnet and there is no gateway.
+// Reopen the stream if the address or the next hop's MAC changes.
+err_t netif_rmii_ethernet_udp_stream_open(netif_rmii_ethernet_udp_stream_t *s,
+					  const ip4_addr_t *dst,
+					  uint16_t dst_port,
+					  uint16_t src_port);
+
+// Send data, split into MTU sized datagrams if it doesn't fit in one
+// Call both from the same core as netif_rmii_ethernet_poll()
+err_t netif_rmii_ethernet_udp_stream_send(netif_rmii_ethernet_udp_stream_t *s,
+					  const void *data, uint len);
+
+// Packet capture (USE_CAPTURE)
+#define NETIF_RMII_CAPTURE_RX 0x01
+#define NETIF_RMII_CAPTURE_TX 0x02
+
+// A frame is captured if it matches all the non-zero fields
+typedef struct {
+  uint8_t dir;        // NETIF_RMII_CAPTURE_RX and/or _TX, 0 for both
+  uint16_t eth_type;  // EtherType
+  uint8_t ip_proto;   // IPv4 protocol
+  uint16_t port;      // TCP/UDP source or destination port
+} netif_rmii_ethernet_capture_filter_t;
+
+// Start capturing, NULL filter captures everything, 0 snaplen for maximum
+// Call from the same core as netif_rmii_ethernet_poll()
+void netif_rmii_ethernet_capture_start
+     (const netif_rmii_ethernet_capture_filter_t *filter, uint snaplen);
+void netif_rmii_ethernet_capture_stop();
+
+// Print up to max (0 for all) captured frames to stdio as pcapng blocks,
+// one "PCAPNG <base64>" line each. Returns the number of frames printed.
+// Call from either core, but only from one.
+uint netif_rmii_ethernet_capture_drain(uint max);
+
+// RX classifier (USE_RX_CLASSIFIER)
+// Actions for frames matching a rule
+#define NETIF_RMII_RX_LWIP  0  // Carry on as usual, raw handlers then LWIP
+#define NETIF_RMII_RX_DROP  1
+#define NETIF_RMII_RX_RAW   2  // The rule's raw handler, without a pbuf
+#define NETIF_RMII_RX_CORE0 3  // Queue for netif_rmii_ethernet_rx_dequeue()
+#define NETIF_RMII_RX_CORE1 4  // on core 0 or core 1
+
+#define NETIF_RMII_RX_NUM_RULE 16
+
+// A rule matches a frame if all its non-zero fields (dscp non-negative)
+// match. Protocol, DSCP and port only match IPv4.
+typedef struct {
+  uint16_t eth_type;  // EtherType
+  uint8_t ip_proto;   // IPv4 protocol
+  int8_t dscp;        // IPv4 DSCP, -1 for any
+  uint16_t port;      // TCP/UDP source or destination port
+  uint8_t action;     // NETIF_RMII_RX_*
+  netif_rmii_ethernet_raw_fn fn;  // Handler for NETIF_RMII_RX_RAW
+  void *arg;
+} netif_rmii_ethernet_rx_rule_t;
+
+// Replace the rule table, the first matching rule applies to a frame
+// Returns false if there are more than NETIF_RMII_RX_NUM_RULE rules.
+// No rules (n = 0) turns the classifier off.
+// Call from the same core as netif_rmii_ethernet_poll()
+bool netif_rmii_ethernet_rx_set_rules
+     (const netif_rmii_ethernet_rx_rule_t *rules, uint n);
+
+// Next frame queued for the calling core, NULL if there is none. The pbuf
+// holds the frame as LWIP would get it, free it with pbuf_free().
+struct pbuf *netif_rmii_ethernet_rx_dequeue();
+
+// Early header (USE_RX_EARLY_HDR)
+// Called from an interrupt with the first len bytes of a frame, destination
+// MAC onwards, while the rest is still arriving. Nothing is checked yet.
+typedef void (*netif_rmii_ethernet_early_fn)(const uint8_t *hdr, uint len,
+					     void *arg);
+
+// Called once that frame is checked, crc_ok is false if it was dropped.
+// From the EOF interrupt, or the poll loop where it checks the CRC.
+typedef void (*netif_rmii_ethernet_early_done_fn)(bool crc_ok, void *arg);
+
+// Set the handlers and the header length, up to 60 bytes (42 covers
+// Ethernet, IPv4 and UDP headers). done may be NULL, NULL fn turns it off.
+// Returns false for a bad length.
+bool netif_rmii_ethernet_set_early_handler(uint len,
+					   netif_rmii_ethernet_early_fn fn,
+					   netif_rmii_ethernet_early_done_fn done,
+					   void *arg);
+
+// Persisted DHCP lease and ARP entries (rmii_ethernet_lease.c)
+// Replaces dhcp_start(). Call before the link comes up, i.e. before the
+// first netif_rmii_ethernet_poll(). A lease saved in flash is resumed with
+// INIT-REBOOT, and its ARP entries loaded once the lease is confirmed.
+// The lease is saved a few seconds after it is bound, if it changed.
+// Saving uses flash_safe_execute(), so the other core must be able to be
+// locked out, see flash_safe_execute_core_init().
+err_t netif_rmii_ethernet_dhcp_resume(struct netif *netif);
+
+// Save the lease and ARP entries now, if they changed
+void netif_rmii_ethernet_lease_save(struct netif *netif);
+
 extern int phy_address;
 #endif
@@ -42,18 +42,71 @@
 #define LWIP_ICMP                       1
 #define LWIP_UDP                        1
 #define LWIP_TCP                        1
-#define ETH_PAD_SIZE                    0
+#define ETH_PAD_SIZE                    2
 #define LWIP_IP_ACCEPT_UDP_PORT(p)      ((p) == PP_NTOHS(67))
 
 #define LWIP_NETIF_LINK_CALLBACK        1
 #define LWIP_NETIF_STATUS_CALLBACK      1
 
 #define TCP_MSS                         (1500 /*mtu*/ - 20 /*iphdr*/ - 20 /*tcphhr*/)
-#define TCP_SND_BUF                     (2 * TCP_MSS)
+#define TCP_SND_BUF                     (8 * TCP_MSS)
+#define TCP_SND_QUEUELEN                ((4 * (TCP_SND_BUF) + (TCP_MSS - 1)) / (TCP_MSS))
+
+/* Room for several connections with full send windows. Zero copy writes
+   only take a ROM pbuf and a header from the heap per segment */
+#define MEMP_NUM_TCP_PCB                8
+#define MEMP_NUM_TCP_SEG                64
+#define MEMP_NUM_PBUF                   64
+#define MEM_SIZE                        16384
+
+/* SYS_ARCH_PROTECT as a spinlock with interrupts masked, in place of an SDK
+   mutex. Nests, and keeps memp pools and pbuf reference counts safe from
+   interrupts and from either core. 0 for the mutex */
+#define RMII_SYS_ARCH_SPINLOCK          1
+
+/* Single segment RX pbufs owned by the RMII driver, 0 disables */
+#define LWIP_SUPPORT_CUSTOM_PBUF        1
+#define RMII_RX_PBUF_COUNT              8
+#define RMII_RX_PBUF_SIZE               1536
+
+/* Free RX pbufs cached per core, so steady state receive skips memp. At
+   most RMII_RX_PBUF_COUNT / (2 * cores) */
+#define RMII_RX_PBUF_CACHE              2
+
+/* Bulk LWIP copies (pbuf_copy, pbuf_take, tcp_write with copy) through a
+   DMA channel when at least RMII_DMA_MEMCPY_MIN bytes. Off until measured:
+   run the memcpy_bench example to find the crossover for a given chip and
+   clock, then set the threshold and 1 to enable */
+#define RMII_DMA_MEMCPY                 0
+#define RMII_DMA_MEMCPY_MIN             128
+
+#include <stddef.h>
+void *rmii_ethernet_memcpy(void *dst, const void *src, size_t len);
+void *rmii_ethernet_memcpy_dma(void *dst, const void *src, size_t len);
+
+#if RMII_DMA_MEMCPY
+#define MEMCPY(dst,src,len)             rmii_ethernet_memcpy(dst,src,len)
+#endif
+
+/* Internet checksum in assembly (chksum.S) on the Cortex-M0+ and M33, LWIP's
+   C version otherwise. Run the chksum_bench example to compare the two */
+#if defined(__ARM_ARCH_6M__) || defined(__ARM_ARCH_8M_MAIN__)
+#define RMII_ASM_CHKSUM                 1
+#else
+#define RMII_ASM_CHKSUM                 0
+#endif
+
+#include <stdint.h>
+uint16_t rmii_ethernet_chksum(const void *dataptr, int len);
+
+#if RMII_ASM_CHKSUM
+#define LWIP_CHKSUM                     rmii_ethernet_chksum
+#endif
 
 #define LWIP_HTTPD_CGI                  0
 #define LWIP_HTTPD_SSI                  0
 #define LWIP_HTTPD_SSI_INCLUDE_TAG      0
+#define LWIP_HTTPD_SUPPORT_11_KEEPALIVE 1
 
 #if 0
 //#if 1
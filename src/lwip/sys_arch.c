@@ -6,24 +6,59 @@
 
 #include "pico/mutex.h"
 #include "pico/stdlib.h"
+#include "hardware/sync.h"
 
 #include "lwip/init.h"
 
+#if RMII_SYS_ARCH_SPINLOCK
+
+#ifndef RMII_SYS_ARCH_SPINLOCK_ID
+#define RMII_SYS_ARCH_SPINLOCK_ID PICO_SPINLOCK_ID_OS1
+#endif
+
+/* Interrupts masked and a spinlock held, so the other core and interrupts
+   on this one are both kept out. Calls nest, only the outermost level
+   takes and releases the lock. */
+static uint lwip_protect_depth[NUM_CORES];
+
+sys_prot_t __not_in_flash_func(sys_arch_protect)(void) {
+    uint32_t save = save_and_disable_interrupts();
+
+    if (lwip_protect_depth[get_core_num()]++ == 0) {
+        spin_lock_unsafe_blocking(spin_lock_instance(RMII_SYS_ARCH_SPINLOCK_ID));
+    }
+
+    return (sys_prot_t)save;
+}
+
+void __not_in_flash_func(sys_arch_unprotect)(sys_prot_t pval) {
+    if (--lwip_protect_depth[get_core_num()] == 0) {
+        spin_unlock_unsafe(spin_lock_instance(RMII_SYS_ARCH_SPINLOCK_ID));
+    }
+
+    restore_interrupts((uint32_t)pval);
+}
+
+#else
+
 auto_init_mutex(lwip_mutex);
 
-/* lwip has provision for using a mutex, when applicable */
-sys_prot_t sys_arch_protect(void) {
+/* lwip has provision for using a mutex, when applicable. In SRAM like the
+   spinlock version, both are on the hot path list in CMakeLists.txt. */
+sys_prot_t __not_in_flash_func(sys_arch_protect)(void) {
     mutex_enter_blocking(&lwip_mutex);
 
     return 0;
 }
 
-void sys_arch_unprotect(sys_prot_t pval) {
+void __not_in_flash_func(sys_arch_unprotect)(sys_prot_t pval) {
     (void) pval;
 
     mutex_exit(&lwip_mutex);
 }
 
+#endif
+
 /* lwip needs a millisecond time source, and the TinyUSB board support code has one available */
 uint32_t sys_now(void) {
     return to_ms_since_boot(get_absolute_time());
@@ -26,7 +26,11 @@
 #include "pico/unique_id.h"
 
 #include "lwip/etharp.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/memp.h"
 #include "lwip/netif.h"
+#include "lwip/prot/tcp.h"
+#include "lwip/stats.h"
 #include "lwip/timeouts.h"
 
 #include "rmii_ethernet_phy_rx.pio.h"
@@ -40,6 +44,7 @@
 #endif
 
 #include "rmii_ethernet/netif.h"
+#include "rmii_ethernet_classify.h"
 
 // Uncomment to enable setting I/O thresholds to 1.8v
 #define EN_1V8
@@ -50,6 +55,9 @@
 // Uncomment to set MAC address
 //#define PICO_RMII_ETHERNET_MAC_ADDR   {0xb8, 0x27, 0xeb, 0xde, 0xad, 0x00}
 
+// Uncomment to set the PHY address, instead of scanning MDIO for it
+//#define PICO_RMII_ETHERNET_PHY_ADDR   1
+
 // Should be able to double buffer at least two full Ethernet frames
 #define RX_BUF_SIZE_POW 12
 #define RX_BUF_SIZE (1 << RX_BUF_SIZE_POW)
@@ -80,10 +88,16 @@ static volatile uint32_t rx_curr_pkt_ptr = 0;
 
 // Start of current packet. Used only by ISR
 static uint32_t rx_addr = 0;
+// Last RX PIO length counter value, the PIO counter also starts at zero
+static uint32_t rx_last_trailer = 0;
 
 // Used by ethernet_poll()
 static uint32_t rx_prev_pkt_ptr = 0;
 
+// RX frames dropped by ethernet_poll(), updated once per poll
+uint32_t rx_drop_crc = 0;
+uint32_t rx_drop_nobuf = 0;
+
 // Max Ethernet frame size is:
 // mac src + mac dst + type + payload + crc
 //    6         6        2      1500     4 = 1518
@@ -94,6 +108,20 @@ static uint32_t rx_prev_pkt_ptr = 0;
 #define TX_BUF_SIZE (1 << TX_BUF_SIZE_POW)
 #define TX_BUF_MASK (TX_BUF_SIZE - 1)
 
+// Ring bytes used by a frame of len bytes (without CRC or ETH_PAD_SIZE): a
+// 32 bit dibit count word, TX_FRAME_OFFSET bytes skipped by the TX PIO, the
+// frame padded to minimum size, the CRC, and 1-4 bytes of padding that the
+// TX PIO discards, so every entry is a whole number of words
+#define TX_RING_ENTRY_LEN(len) \
+  (4 + ((TX_FRAME_OFFSET + ((len) < 60 ? 60 : (len)) + 4 + 4) & ~3))
+
+// LWIP's padding in front of the Ethernet header takes the place of the
+// RX/TX frame offset bytes, so frames copy with matching word alignment
+#if (ETH_PAD_SIZE != 0) && \
+  ((ETH_PAD_SIZE != RX_FRAME_OFFSET) || (ETH_PAD_SIZE != TX_FRAME_OFFSET))
+#error "ETH_PAD_SIZE must be 0, or match the PIO frame offsets"
+#endif
+
 // Make an aligned TX ring buffer
 // Alignment allows the DMA engine to use wrapped addressing
 static volatile uint8_t tx_ring[TX_BUF_SIZE] __attribute__((aligned (TX_BUF_SIZE)));
@@ -107,7 +135,7 @@ static volatile uint8_t tx_ring[TX_BUF_SIZE] __attribute__((aligned (TX_BUF_SIZE
 // Above, in bytes
 #define TX_NUM_PTR_POW_BYTES (TX_NUM_PTR_POW + 2)
 
-// Holds transmit packet length
+// Holds transmit packet length, in words (the TX DMA transfer count)
 // Must be aligned to be used as a ring buffer
 static volatile uint32_t tx_pkt_ptr[TX_NUM_PTR] __attribute__((aligned (TX_NUM_PTR)));
 
@@ -134,6 +162,10 @@ static int pbuf_chan;
 static dma_channel_config pbuf_rx_channel_config;
 static dma_channel_config pbuf_tx_channel_config;
 static dma_channel_config pbuf_tx_no_inc_channel_config;
+static dma_channel_config pbuf_rx32_channel_config;
+static dma_channel_config pbuf_tx32_channel_config;
+static dma_channel_config pbuf_crc_channel_config;
+static dma_channel_config pbuf_crc32_channel_config;
 
 // Reload the RX DMA engine with this value
 uint32_t rx_ctl_reload;
@@ -145,6 +177,11 @@ int phy_address = 0xffff;
 // See https://en.wikipedia.org/wiki/Ethernet_frame#Frame_check_sequence
 static const uint32_t crc_check_value = 0xdebb20e3;
 
+// Sniffer seed that two zero bytes turn into the CRC initial value, in the
+// sniffer's internal (bit reversed) order. Lets the sniffer run over the
+// frame offset bytes in front of a frame.
+#define CRC_SNIFF_PAD_SEED 0x09b93859
+
 // Select one of the two CRC calculation methods below
 // Enable using the DMA sniffer for CRC calculations
 #define USE_DMA_CRC
@@ -152,7 +189,309 @@ static const uint32_t crc_check_value = 0xdebb20e3;
 // Enable using the CPU for CRC calculations
 //#define USE_CPU_CRC
 
-#ifdef USE_CPU_CRC
+// With USE_DMA_CRC, enable checking RX CRC at line rate: the sniffer watches
+// the RX stream DMA channel, and the EOF ISR latches the result per frame.
+// Bad frames never reach the poll loop. There is only one sniffer, so TX
+// CRC is calculated by the CPU while copying into the TX ring.
+//#define USE_RX_LINE_CRC
+
+#if defined(USE_DMA_CRC) && !defined(USE_RX_LINE_CRC)
+#define USE_DMA_TX_CRC
+#else
+#define USE_CPU_TX_CRC
+#endif
+
+// RP2350 DMA channels can run with an endless transfer count, so the RX
+// channel never needs reloading, and TX frames are started from the DMA
+// completion interrupt. This frees the two DMA chain channels.
+#if PICO_RP2350
+#define USE_SINGLE_CHAN_DMA
+#endif
+
+#ifdef USE_SINGLE_CHAN_DMA
+// Next TX command to be started, and its lock
+static volatile uint32_t tx_cmd_rd = 0;
+static spin_lock_t *tx_cmd_lock;
+#endif
+
+// Enable IEEE 802.3x flow control
+// Sends PAUSE frames when the RX ring fills past the high watermark, and
+// a zero quanta PAUSE (resume) once it drains below the low watermark.
+// Received PAUSE frames hold off the TX DMA chain for the requested time.
+#define USE_PAUSE_FRAMES
+
+#ifdef USE_PAUSE_FRAMES
+// RX ring occupancy thresholds, in bytes and in packet pointers
+#define RX_PAUSE_HIGH_BYTES ((RX_BUF_SIZE * 3) / 4)
+#define RX_PAUSE_LOW_BYTES  (RX_BUF_SIZE / 4)
+#define RX_PAUSE_HIGH_PKTS  ((RX_NUM_PTR * 3) / 4)
+#define RX_PAUSE_LOW_PKTS   (RX_NUM_PTR / 4)
+
+// Pause time requested from the link partner, in 512 bit time quanta
+// 0xffff quanta is about 335 ms at 100 Mbit/sec
+#define RX_PAUSE_QUANTA     0xffff
+
+// One quanta is 512 bit times, or 5.12 us at 100 Mbit/sec
+#define PAUSE_QUANTA_TO_US(q) (((uint64_t)(q) * 512) / 100)
+
+// MAC control frame parameters
+#define ETH_TYPE_MAC_CONTROL 0x8808
+#define MAC_CONTROL_OP_PAUSE 0x0001
+
+// Flow control state, only touched by the poll loop
+static bool rx_pause_active = false;
+static absolute_time_t rx_pause_refresh_time;
+static bool tx_paused = false;
+static absolute_time_t tx_pause_end_time;
+#ifdef USE_SINGLE_CHAN_DMA
+// Queued frames held back while a PAUSE frame goes out
+static volatile bool tx_pause_hold = false;
+#endif
+
+// Flow control statistics
+uint32_t pause_tx_count = 0;
+uint32_t pause_rx_count = 0;
+
+// Outbound PAUSE frame, padded to minimum length by the output routine
+// LWIP style padding in front, like frames handed to the output routine
+static uint8_t pause_frame[ETH_PAD_SIZE + 60] __attribute__((aligned (4)));
+static struct pbuf pause_pbuf;
+
+// The PAUSE frame as a TX ring entry, sent ahead of the TX ring. Aligned
+// so the packet channel's read ring wrap never splits it.
+static uint32_t pause_ring[TX_RING_ENTRY_LEN(60) / 4] __attribute__((aligned (128)));
+#endif
+
+// Enable software TX priority queues
+// Outbound frames are classified by 802.1p PCP, IPv4 DSCP, or an application
+// classifier, and fed to the TX ring by a strict priority scheduler with
+// an optional token bucket shaper per class.
+//#define USE_TX_PRIORITY
+
+#ifdef USE_TX_PRIORITY
+// Number of traffic classes, class 0 is lowest priority
+#define TX_NUM_CLASS 4
+
+// Frames held per class
+#define TX_QUEUE_LEN_POW 4
+#define TX_QUEUE_LEN (1 << TX_QUEUE_LEN_POW)
+#define TX_QUEUE_MASK (TX_QUEUE_LEN - 1)
+
+// Bytes the scheduler allows in the TX ring. Two full size frames keep
+// the wire busy, while an urgent frame waits for at most that much.
+#define TX_HW_DEPTH (2 * TX_RING_ENTRY_LEN(1514))
+#endif
+
+// Enable in-driver packet capture
+// Frames are copied, truncated to a snap length, into a ring of capture
+// slots as they are received (after the CRC check) and sent. Costs a single
+// branch per frame while capture is stopped. When the ring is full the
+// capture is dropped, never the frame. The ring is drained as a pcapng
+// stream over stdio, see netif_rmii_ethernet_capture_drain().
+//#define USE_CAPTURE
+
+#ifdef USE_CAPTURE
+// Number of capture slots
+#define CAP_NUM_SLOT_POW 5
+#define CAP_NUM_SLOT (1 << CAP_NUM_SLOT_POW)
+#define CAP_NUM_MASK (CAP_NUM_SLOT - 1)
+
+// Largest snap length, also holds the headers the filter looks at
+#define CAP_MAX_SNAPLEN 128
+
+typedef struct {
+  uint64_t time;      // Microseconds since boot
+  uint16_t len;       // Bytes captured
+  uint16_t orig_len;  // Frame length, without FCS
+  uint8_t flags;      // NETIF_RMII_CAPTURE_RX or NETIF_RMII_CAPTURE_TX
+  uint8_t data[CAP_MAX_SNAPLEN];
+} cap_slot_t;
+
+// Single producer (poll core), single consumer (drainer) ring
+// Indices run free, the producer owns cap_wr, the drainer owns cap_rd
+static cap_slot_t cap_slot[CAP_NUM_SLOT];
+static volatile uint32_t cap_wr = 0;
+static volatile uint32_t cap_rd = 0;
+
+static volatile bool cap_active = false;
+static netif_rmii_ethernet_capture_filter_t cap_filter;
+static uint32_t cap_snaplen = CAP_MAX_SNAPLEN;
+
+// Drainer has to start a new pcapng section
+static volatile bool cap_new_section = false;
+
+// Capture statistics
+uint32_t cap_count = 0;
+uint32_t cap_drops = 0;
+#endif
+
+// Enable fast boot
+// Initialization returns as soon as the PIO and DMA are running. PHY reset
+// timing, PHY address discovery and autonegotiation setup are then done by
+// the poll loop, one non-blocking MDIO transaction at a time, and link up
+// is reported through the netif link callback. arch_pico_init() no longer
+// waits for stdio, so early output over USB may be lost.
+//#define USE_FAST_BOOT
+
+#ifdef USE_FAST_BOOT
+// PHY bring-up states, run from the poll loop
+enum phy_init_states {
+  PHY_RESET,       // Reset held until the RMII clock has run long enough
+  PHY_FIND,        // Looking for a PHY answering on MDIO
+  PHY_SOFT_RESET,  // Soft reset, for boards without a reset pin
+  PHY_AUTO_NEGO,   // Write advertised abilities
+  PHY_START,       // Enable autonegotiation
+  PHY_RUN,         // Up, polling link status
+  PHY_FAILED       // No PHY found, link stays down
+};
+
+static enum phy_init_states phy_init_state = PHY_RUN;
+static absolute_time_t phy_init_time;
+static absolute_time_t phy_find_time;
+static uint32_t phy_scan_addr = 0;
+static uint32_t phy_scan_count = 0;
+static bool phy_read_pending = false;
+
+// Link status poll interval while the link is down
+#define PHY_LINK_DOWN_POLL_MS 10
+
+// Time from reset release to giving up on finding a PHY, twice the fixed
+// wait of a normal boot. At least one full address scan is always done.
+#define PHY_FIND_TIMEOUT_MS 200
+#endif
+
+// Enable the RX classifier
+// Received frames are matched against a rule table (EtherType, IPv4
+// protocol, DSCP, TCP/UDP port) before going to LWIP. Matching frames can be
+// dropped, handed to a raw handler, or queued for a core to pick up, so
+// control traffic doesn't wait behind bulk TCP. The table is compiled into
+// per field lookup tables, so the cost per frame doesn't grow with it.
+// See rmii_ethernet_classify.c.
+//#define USE_RX_CLASSIFIER
+
+#ifdef USE_RX_CLASSIFIER
+// Frames queued per core
+#define RX_QUEUE_LEN_POW 4
+#define RX_QUEUE_LEN (1 << RX_QUEUE_LEN_POW)
+#define RX_QUEUE_MASK (RX_QUEUE_LEN - 1)
+
+static rx_cls_t rx_cls;
+static bool rx_cls_active = false;
+
+// Single producer (poll core), single consumer (target core) queues
+// Indices run free, the producer owns wr, the consumer owns rd
+typedef struct {
+  struct pbuf *p[RX_QUEUE_LEN];
+  volatile uint32_t wr;
+  volatile uint32_t rd;
+} rx_queue_t;
+
+static rx_queue_t rx_queue[NUM_CORES];
+
+// Classifier statistics
+uint32_t rx_cls_drops = 0;        // Dropped by a rule
+uint32_t rx_cls_queued = 0;
+uint32_t rx_cls_queue_drops = 0;  // Queue full, or no pbuf
+#endif
+
+// Enable the early header interrupt
+// The RX PIO program sets PIO IRQ 1 as each frame starts. A hardware alarm
+// then fires once the first bytes of the frame are due in the RX ring, and
+// an application handler gets them while the rest of the frame is still
+// arriving, to classify it or get a response ready. A second handler gets
+// the frame's CRC verdict once it is known.
+//#define USE_RX_EARLY_HDR
+
+#ifdef USE_RX_EARLY_HDR
+// Longest early header, a minimum size frame without FCS
+#define RX_EARLY_MAX 60
+
+// Alarm margin after the header's wire time, for the RX FIFO and DMA
+#define RX_EARLY_MARGIN_US 1
+
+// Longest the alarm waits for a late header
+#define RX_EARLY_WAIT_US 2
+
+// Set in rx_pkt_ptr[].pkt_len when the CRC verdict is due from the poll
+#define RX_PKT_EARLY 0x8000
+
+static netif_rmii_ethernet_early_fn rx_early_fn = NULL;
+static netif_rmii_ethernet_early_done_fn rx_early_done_fn = NULL;
+static void *rx_early_arg;
+static uint32_t rx_early_len;
+static uint32_t rx_early_delay_us;
+static uint rx_early_alarm;
+
+// Frames ended by the EOF ISR, and the count as the current frame started.
+// The SOF, alarm and EOF ISRs all run on one core, one at a time.
+static uint32_t rx_eof_seq = 0;
+static uint32_t rx_early_seq;
+
+// The early handler was called for the current frame
+static bool rx_early_called = false;
+
+// Early handler calls, and frames whose header came too late
+uint32_t rx_early_count = 0;
+uint32_t rx_early_late = 0;
+#endif
+
+// Enable the ARP and ping responder
+// ARP requests for our address and ICMP echo requests to it are answered
+// from the poll loop, straight from the RX ring into the TX ring, without
+// pbufs or LWIP. Replies reuse the request, with checksums updated
+// incrementally. Fragmented echo requests (ping -s 10400) are answered one
+// fragment at a time, as long as the first fragment arrives first. ARP
+// requests from hosts LWIP has no ARP entry for still go to LWIP.
+//#define USE_ECHO_OFFLOAD
+
+#ifdef USE_ECHO_OFFLOAD
+// Fragmented echo requests being answered, by source address and IP ID
+#define ECHO_NUM_FRAG 4
+
+typedef struct {
+  uint32_t src;
+  uint16_t id;
+  bool used;
+} echo_frag_t;
+
+static echo_frag_t echo_frag[ECHO_NUM_FRAG];
+static uint echo_frag_next = 0;
+
+// Replies sent
+uint32_t echo_arp_replies = 0;
+uint32_t echo_icmp_replies = 0;
+#endif
+
+// Enable receive TCP segment coalescing
+// Within one poll, consecutive in-order segments of the same TCP flow are
+// merged into one pbuf chain before going to LWIP, so it runs its TCP input
+// and ACK processing once per merged segment rather than once per frame.
+// Holds up to RX_GRO_MAX_SEGS pool pbufs, so keep it below
+// RMII_RX_PBUF_COUNT.
+//#define USE_RX_GRO
+
+#ifdef USE_RX_GRO
+// Limits for a merged segment, the byte limit is LWIP's default window
+#define RX_GRO_MAX_SEGS 4
+#define RX_GRO_MAX_BYTES (4 * TCP_MSS)
+
+// Segment being built
+typedef struct {
+  struct pbuf *p;     // First frame, later payloads chained on, NULL if none
+  uint32_t seq;       // Sequence number expected next
+  uint32_t data_sum;  // One's complement sum of the TCP payload so far
+  uint16_t data_len;
+  uint16_t segs;
+} rx_gro_t;
+
+static rx_gro_t rx_gro;
+
+// Frames merged into an earlier one, and merged segments passed to LWIP
+uint32_t rx_gro_merged = 0;
+uint32_t rx_gro_flushes = 0;
+#endif
+
+#ifdef USE_CPU_TX_CRC
 static uint32_t crc32Lookup[256] =
 { 0x00000000,0x77073096,0xEE0E612C,0x990951BA,0x076DC419,0x706AF48F,0xE963A535,0x9E6495A3,
   0x0EDB8832,0x79DCB8A4,0xE0D5E91E,0x97D2D988,0x09B64C2B,0x7EB17CBD,0xE7B82D07,0x90BF1D91,
@@ -189,30 +528,349 @@ static uint32_t crc32Lookup[256] =
 };
 #endif
 
+#ifdef USE_RX_LINE_CRC
+// Table index for each table entry's top byte, they're all different.
+// Built by netif_rmii_ethernet_low_init(), used to step the CRC backwards.
+static uint8_t crc32Reverse[256];
+
+// RX frames dropped by the EOF ISR for a bad CRC, the poll loop adds them
+// to rx_drop_crc
+static volatile uint32_t rx_line_crc_drops = 0;
+static uint32_t rx_line_crc_seen = 0;
+
+// Undo the CRC update for byte b
+static inline uint32_t crc32_unbyte(uint32_t crc, uint8_t b) {
+  uint8_t idx = crc32Reverse[crc >> 24];
+
+  return ((crc ^ crc32Lookup[idx]) << 8) | (idx ^ b);
+}
+
+// Undo the CRC update for the four bytes of a word, LSB first
+static inline uint32_t crc32_unword(uint32_t crc, uint32_t w) {
+  for (int i = 24; i >= 0; i -= 8) {
+    crc = crc32_unbyte(crc, w >> i);
+  }
+
+  return crc;
+}
+#endif
+
 uint32_t count = 10;
 
-// Fetch data from ring buffer, calculate CRC, write data to destination pbuf
-// Return length (valid) or zero (invalid CRC)
-static uint __not_in_flash_func(ethernet_frame_to_pbuf)
+// Driver owned RX pbufs, each large enough for a full frame, so a frame
+// is always copied out of the ring with a single DMA transfer.
+// Sized by RMII_RX_PBUF_COUNT/RMII_RX_PBUF_SIZE in lwipopts.h. When the
+// pool is empty, we fall back to a chain from the LWIP pbuf pool.
+#ifndef RMII_RX_PBUF_COUNT
+#define RMII_RX_PBUF_COUNT 0
+#endif
+
+#ifndef RMII_RX_PBUF_SIZE
+#define RMII_RX_PBUF_SIZE 1536
+#endif
+
+// Free pool pbufs kept per core, see rx_pbuf_cache_t. 0 disables.
+#ifndef RMII_RX_PBUF_CACHE
+#define RMII_RX_PBUF_CACHE 2
+#endif
+
+#if RMII_RX_PBUF_COUNT > 0
+typedef struct {
+  struct pbuf_custom pc;
+  uint8_t payload[RMII_RX_PBUF_SIZE] __attribute__((aligned (4)));
+} rx_pbuf_t;
+
+LWIP_MEMPOOL_DECLARE(RMII_RX_PBUF, RMII_RX_PBUF_COUNT, sizeof(rx_pbuf_t),
+		     "RMII RX pbuf");
+
+// Hit/miss counts for the single segment pool
+uint32_t rx_pbuf_pool_hits = 0;
+uint32_t rx_pbuf_pool_misses = 0;
+
+#if RMII_RX_PBUF_CACHE > 0
+// Per-core cache of free pool pbufs, in front of the pool. Each core only
+// touches its own, with interrupts masked, so no lock is needed. The pool
+// is only used when a cache runs empty or full, half a cache at a time.
+// A core that only frees pbufs, like the consumer of the RX classifier's
+// queues, can end up holding a full cache, so all the caches together are
+// kept to half the pool.
+#if RMII_RX_PBUF_CACHE > RMII_RX_PBUF_COUNT / (2 * NUM_CORES)
+#error "RMII_RX_PBUF_CACHE must be at most RMII_RX_PBUF_COUNT / (2 * NUM_CORES)"
+#endif
+
+typedef struct {
+  uint count;
+  rx_pbuf_t *buf[RMII_RX_PBUF_CACHE];
+} rx_pbuf_cache_t;
+
+static rx_pbuf_cache_t rx_pbuf_cache[NUM_CORES];
+
+// Allocations served from the cache, and refills from the pool
+uint32_t rx_pbuf_cache_hits = 0;
+uint32_t rx_pbuf_cache_misses = 0;
+#endif
+
+// Take a free pool pbuf, NULL if there are none left
+static rx_pbuf_t *__not_in_flash_func(rx_pbuf_get)() {
+#if RMII_RX_PBUF_CACHE > 0
+  uint32_t irq_save = save_and_disable_interrupts();
+  rx_pbuf_cache_t *c = &rx_pbuf_cache[get_core_num()];
+  rx_pbuf_t *rp = NULL;
+
+  if (c->count > 0) {
+    rx_pbuf_cache_hits++;
+  } else {
+    rx_pbuf_cache_misses++;
+
+    while (c->count < (RMII_RX_PBUF_CACHE + 1) / 2) {
+      rp = (rx_pbuf_t *)LWIP_MEMPOOL_ALLOC(RMII_RX_PBUF);
+      if (rp == NULL) break;
+      c->buf[c->count++] = rp;
+    }
+  }
+
+  rp = (c->count > 0) ? c->buf[--c->count] : NULL;
+
+  restore_interrupts(irq_save);
+
+  return rp;
+#else
+  return (rx_pbuf_t *)LWIP_MEMPOOL_ALLOC(RMII_RX_PBUF);
+#endif
+}
+
+// Called by LWIP when the last reference to a pool pbuf is dropped
+static void __not_in_flash_func(rx_pbuf_free)(struct pbuf *p) {
+#if RMII_RX_PBUF_CACHE > 0
+  uint32_t irq_save = save_and_disable_interrupts();
+  rx_pbuf_cache_t *c = &rx_pbuf_cache[get_core_num()];
+
+  // Full, hand half back to the pool
+  if (c->count == RMII_RX_PBUF_CACHE) {
+    while (c->count > RMII_RX_PBUF_CACHE / 2) {
+      LWIP_MEMPOOL_FREE(RMII_RX_PBUF, c->buf[--c->count]);
+    }
+  }
+
+  c->buf[c->count++] = (rx_pbuf_t *)p;
+
+  restore_interrupts(irq_save);
+#else
+  LWIP_MEMPOOL_FREE(RMII_RX_PBUF, p);
+#endif
+}
+#endif
+
+// Allocate a pbuf for a received frame, single segment if possible
+static struct pbuf *__not_in_flash_func(rx_pbuf_alloc)(uint16_t len) {
+#if RMII_RX_PBUF_COUNT > 0
+  if (len <= RMII_RX_PBUF_SIZE) {
+    rx_pbuf_t *rp = rx_pbuf_get();
+
+    if (rp != NULL) {
+      rx_pbuf_pool_hits++;
+      rp->pc.custom_free_function = rx_pbuf_free;
+      return pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &rp->pc,
+				 rp->payload, RMII_RX_PBUF_SIZE);
+    }
+  }
+
+  rx_pbuf_pool_misses++;
+#endif
+
+  return pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+}
+
+#ifdef USE_DMA_CRC
+#if (RX_FRAME_OFFSET != 2) || (TX_FRAME_OFFSET != 2)
+#error "CRC_SNIFF_PAD_SEED assumes two frame offset bytes"
+#endif
+
+// Start a sniffer CRC at the zeroed frame offset bytes in front of a frame
+// The seed is written with output reversal off, so it isn't transformed.
+static inline void crc_sniff_seed_pad(void) {
+  hw_clear_bits(&dma_hw->sniff_ctrl, DMA_SNIFF_CTRL_OUT_REV_BITS);
+  dma_hw->sniff_data = CRC_SNIFF_PAD_SEED;
+  hw_set_bits(&dma_hw->sniff_ctrl, DMA_SNIFF_CTRL_OUT_REV_BITS);
+}
+
+// Copy len bytes with the pbuf DMA channel, moving the word aligned bulk
+// as 32 bit transfers. Byte transfers are used for the unaligned head and
+// tail, or for everything if source and destination alignment differ.
+// The sniffer processes 32 bit transfers LSB first, which is the same
+// byte order as the 8 bit transfers, so the CRC32R result is unchanged.
+// Ring wrap is handled by the channel configs: the read and write
+// addresses carry on (wrapped) from one transfer to the next, and an
+// aligned word never straddles the aligned ring boundary.
+static void __not_in_flash_func(pbuf_dma_copy)
+     (volatile void *wr, const volatile void *rd, uint32_t len,
+      const dma_channel_config *cfg8, const dma_channel_config *cfg32) {
+  uint32_t head = 0;
+  uint32_t words = 0;
+  uint32_t tail = len;
+
+  if ((((uint32_t)rd ^ (uint32_t)wr) & 3) == 0) {
+    head = (4 - ((uint32_t)rd & 3)) & 3;
+    if (head > len) head = len;
+    words = (len - head) >> 2;
+    tail = len - head - (words << 2);
+  }
+
+  dma_channel_wait_for_finish_blocking(pbuf_chan);
+  dma_channel_hw_addr(pbuf_chan)->read_addr = (uint32_t)rd;
+  dma_channel_hw_addr(pbuf_chan)->write_addr = (uint32_t)wr;
+
+  if (head) {
+    dma_channel_hw_addr(pbuf_chan)->transfer_count = head;
+    dma_channel_set_config(pbuf_chan, cfg8, true);
+  }
+
+  if (words) {
+    dma_channel_wait_for_finish_blocking(pbuf_chan);
+    dma_channel_hw_addr(pbuf_chan)->transfer_count = words;
+    dma_channel_set_config(pbuf_chan, cfg32, true);
+  }
+
+  if (tail) {
+    dma_channel_wait_for_finish_blocking(pbuf_chan);
+    dma_channel_hw_addr(pbuf_chan)->transfer_count = tail;
+    dma_channel_set_config(pbuf_chan, cfg8, true);
+  }
+}
+#endif
+
+// LWIP MEMCPY() (RMII_DMA_MEMCPY in lwipopts.h)
+// One DMA channel per core, so both cores may copy at the same time. The
+// channels are separate from pbuf_chan and never sniffed, so the CRC
+// sniffer is not disturbed, and they run at normal priority behind the
+// RX and TX streams.
+static int memcpy_chan[2] = { -2, -2 };  // -2 not claimed yet, -1 none free
+static dma_channel_config memcpy_cfg[2];
+
+static int memcpy_chan_claim(uint core) {
+  int chan = dma_claim_unused_channel(false);
+
+  if (chan >= 0) {
+    memcpy_cfg[core] = dma_channel_get_default_config(chan);
+    channel_config_set_read_increment(&memcpy_cfg[core], true);
+    channel_config_set_write_increment(&memcpy_cfg[core], true);
+    channel_config_set_transfer_data_size(&memcpy_cfg[core], DMA_SIZE_32);
+  }
+
+  memcpy_chan[core] = chan;
+  return chan;
+}
+
+// Copy with the DMA, whatever the size. The unaligned head is copied by
+// the CPU first and the tail while the DMA runs. Source and destination
+// must have the same word alignment.
+void *__not_in_flash_func(rmii_ethernet_memcpy_dma)(void *dst, const void *src,
+						    size_t len) {
+  uint core = get_core_num();
+  uint8_t *d = (uint8_t *)dst;
+  const uint8_t *s = (const uint8_t *)src;
+  uint32_t head;
+  uint32_t words;
+  int chan;
+
+  if ((chan = memcpy_chan[core]) == -2) chan = memcpy_chan_claim(core);
+  if (chan < 0) return memcpy(dst, src, len);
+
+  head = (4 - ((uint32_t)d & 3)) & 3;
+  if (head > len) head = len;
+  words = (len - head) >> 2;
+
+  memcpy(d, s, head);
+  d += head;
+  s += head;
+
+  dma_channel_configure(chan, &memcpy_cfg[core], d, s, words, true);
+  memcpy(d + (words << 2), s + (words << 2), len - head - (words << 2));
+  dma_channel_wait_for_finish_blocking(chan);
+
+  return dst;
+}
+
+// Small or differently aligned copies stay with the CPU memcpy(), which
+// already moves words when it can
+void *__not_in_flash_func(rmii_ethernet_memcpy)(void *dst, const void *src,
+						size_t len) {
+
+  if ((len < RMII_DMA_MEMCPY_MIN) ||
+      ((((uint32_t)dst ^ (uint32_t)src) & 3) != 0)) {
+    return memcpy(dst, src, len);
+  }
+
+  return rmii_ethernet_memcpy_dma(dst, src, len);
+}
+
+// Check the CRC of a frame in the RX ring, without copying it. Used when
+// there is no pbuf to check it into, so the frame can still go to the
+// handlers that read it in place. The CRC includes the frame's FCS, so a
+// good frame leaves the check value. Return true for a good frame.
+static bool __not_in_flash_func(ethernet_frame_crc_ok)
+     (volatile uint8_t *data, int len, int addr) {
+
+#if defined(USE_RX_LINE_CRC)
+  // Bad frames were already dropped by the EOF ISR
+  return true;
+#elif defined(USE_DMA_CRC)
+  // Sniff only pass, the DMA reads the frame into a single word sink
+  static uint32_t crc_sink;
+
+  // Start at the zeroed frame offset bytes, so the pass is word aligned
+  dma_channel_wait_for_finish_blocking(pbuf_chan);
+  crc_sniff_seed_pad();
+
+  pbuf_dma_copy(&crc_sink, &data[(addr - RX_FRAME_OFFSET) & RX_BUF_MASK],
+		len + RX_FRAME_OFFSET,
+		&pbuf_crc_channel_config, &pbuf_crc32_channel_config);
+
+  dma_channel_wait_for_finish_blocking(pbuf_chan);
+  return dma_hw->sniff_data == crc_check_value;
+#else
+  uint crc = 0xffffffff;  /* Initial value. */
+
+  for (int i = 0; i < len; i++) {
+    crc = (crc >> 8) ^ crc32Lookup[(crc & 0xff) ^ data[addr]];
+
+    // Wrap address around ring buffer
+    addr = (addr + 1) & RX_BUF_MASK;
+  }
+
+  return crc == crc_check_value;
+#endif
+}
+
+// Fetch data from ring buffer, write data to destination pbuf, checking
+// the CRC along the way. The copy starts ETH_PAD_SIZE bytes in front of
+// the frame. Return true for a good frame.
+static bool __not_in_flash_func(ethernet_frame_to_pbuf)
      (volatile uint8_t *data, 
       struct pbuf *buf,
       int len, int addr) {
   
-  uint crc = 0xffffffff;  /* Initial value. */
-  uint index = 0;
-  uint inverted_crc;
   struct pbuf *p;
   size_t buf_copy_len;
   size_t total_copy_len = len;
-  uint32_t i, j;
-  uint8_t curr_data;
-  uint32_t lsb;
-  uint32_t offset;
+  uint32_t i;
   uint8_t *wr_ptr;
+#ifdef USE_CPU_CRC
+  uint crc = 0xffffffff;  /* Initial value. */
+
+  // LWIP padding in front of the Ethernet header, not in the CRC
+  uint32_t skip = ETH_PAD_SIZE;
+#endif
 
-#ifdef USE_DMA_CRC    
+#if defined(USE_DMA_CRC) && !defined(USE_RX_LINE_CRC)
+  // Make sure we've finished previous transaction
   dma_channel_wait_for_finish_blocking(pbuf_chan);
+#if ETH_PAD_SIZE
+  // The padding is the zeroed frame offset bytes, seed the sniffer to skip it
+  crc_sniff_seed_pad();
+#else
   dma_hw->sniff_data = 0xffffffff;
+#endif
 #endif
 
   // This is from LWIP's pbuf.c, pbuf_take(...) routine
@@ -226,52 +884,45 @@ static uint __not_in_flash_func(ethernet_frame_to_pbuf)
     }
 
 #ifdef USE_DMA_CRC
-    // Setup DMA to copy this portion of the pbuf
-    dma_channel_wait_for_finish_blocking(pbuf_chan);
-    dma_channel_hw_addr(pbuf_chan)->read_addr = (uint32_t)&(data[addr]);
-    dma_channel_hw_addr(pbuf_chan)->write_addr = (uint32_t)(wr_ptr);
-    dma_channel_hw_addr(pbuf_chan)->transfer_count = buf_copy_len;
-
-    // Fire it off
-    dma_channel_set_config(pbuf_chan, &pbuf_rx_channel_config, true);
+    // Setup DMA to copy this portion of the pbuf, and fire it off
+    pbuf_dma_copy(wr_ptr, &data[addr], buf_copy_len,
+		  &pbuf_rx_channel_config, &pbuf_rx32_channel_config);
 
     addr = (addr + buf_copy_len) & RX_BUF_MASK;
-    total_copy_len -= buf_copy_len;
 #endif
 
 #ifdef USE_CPU_CRC
-    // Calculate CRC over payload
-    for (i = 0; i < buf_copy_len; i++) {
+    // The padding isn't looked at by LWIP, leave it out of the copy too
+    wr_ptr += skip;
+    addr = (addr + skip) & RX_BUF_MASK;
+
+    for (i = skip; i < buf_copy_len; i++) {
       // Get data from ring buffer
-      curr_data = data[addr];
+      *wr_ptr = data[addr];
+
+      // Accumulate CRC
+      crc = (crc >> 8) ^ crc32Lookup[(crc & 0xff) ^ *wr_ptr++];
 
       // Wrap address around ring buffer
       addr = (addr + 1) & RX_BUF_MASK;
-
-      // Save data
-      *wr_ptr++ = curr_data;
-
-      // Include packet CRC (i.e. last 4 bytes) in CRC calculation
-      if (total_copy_len > 0) {
-	// Calculate CRC
-	offset = (crc & 0xff) ^ curr_data;
-	crc = (crc >> 8) ^ crc32Lookup[offset];
-      }
-
-      total_copy_len--;
     }
+    skip = 0;
 #endif
+
+    total_copy_len -= buf_copy_len;
   }
 
-#ifdef USE_DMA_CRC
+#if defined(USE_RX_LINE_CRC)
   dma_channel_wait_for_finish_blocking(pbuf_chan);
-  crc = dma_hw->sniff_data;
-#endif
-
-  // Compare CRC against check value
-  if (crc != crc_check_value) len = 0;
 
-  return len;
+  // Bad frames were already dropped by the EOF ISR
+  return true;
+#elif defined(USE_DMA_CRC)
+  dma_channel_wait_for_finish_blocking(pbuf_chan);
+  return dma_hw->sniff_data == crc_check_value;
+#else
+  return crc == crc_check_value;
+#endif
 }
 
 // Copy packet data to ring buffer, adding pkt len, and CRC, for transmission
@@ -290,34 +941,44 @@ static uint __not_in_flash_func(ethernet_frame_copy_ring_pbuf)
   uint32_t lsb;
   uint8_t offset;
 
-#ifdef USE_DMA_CRC    
+  // LWIP padding in front of the Ethernet header, not sent
+  uint32_t skip = ETH_PAD_SIZE;
+
+  // Add length word and frame offset space to start of buffer
+  // Entries are word aligned
+  uint32_t p_addr = addr;
+  addr = (addr + 4 + TX_FRAME_OFFSET) & TX_BUF_MASK;
+
+#ifdef USE_DMA_TX_CRC    
   // Make sure we've finished previous transaction
   dma_channel_wait_for_finish_blocking(pbuf_chan);
+#if ETH_PAD_SIZE
+  // Copy the padding into the frame offset bytes, so source and ring have
+  // the same word alignment. Zero it, and seed the sniffer to skip it.
+  memset(p->payload, 0, ETH_PAD_SIZE);
+  crc_sniff_seed_pad();
+  addr = (addr - ETH_PAD_SIZE) & TX_BUF_MASK;
+  tot_len -= ETH_PAD_SIZE;
+#else
   dma_hw->sniff_data = 0xffffffff;
 #endif
-
-  // Add length parameter space to start of buffer
-  uint32_t p_addr = addr;
-  addr = (addr + 2) & TX_BUF_MASK;
+#endif
 
   // Get the payload from lwip, generating CRC along the way
   for (struct pbuf *q = p; q != NULL; q = q->next) {
-#ifdef USE_DMA_CRC
+#ifdef USE_DMA_TX_CRC
     // Setup DMA to copy this portion of the pbuf
-    dma_channel_wait_for_finish_blocking(pbuf_chan);
-    dma_channel_hw_addr(pbuf_chan)->read_addr = (uint32_t)(q->payload);
-    dma_channel_hw_addr(pbuf_chan)->write_addr = (uint32_t)(&data[addr]);
-    dma_channel_hw_addr(pbuf_chan)->transfer_count = q->len;
-    dma_channel_set_config(pbuf_chan, &pbuf_tx_channel_config, true);
+    pbuf_dma_copy(&data[addr], q->payload, q->len,
+		  &pbuf_tx_channel_config, &pbuf_tx32_channel_config);
 
     // Wrap address around ring buffer
     addr = (addr + q->len) & TX_BUF_MASK;
     tot_len += q->len;
 #endif
 
-#ifdef USE_CPU_CRC
-    for (j = 0; j < q->len; j++) {
-      buf_dat = *(uint8_t *)(q->payload++);
+#ifdef USE_CPU_TX_CRC
+    for (j = skip; j < q->len; j++) {
+      buf_dat = ((uint8_t *)q->payload)[j];
       data[addr] = buf_dat;
       tot_len++;
 
@@ -328,10 +989,11 @@ static uint __not_in_flash_func(ethernet_frame_copy_ring_pbuf)
       offset = (crc & 0xff) ^ buf_dat;
       crc = (crc >> 8) ^ crc32Lookup[offset];
     }
+    skip = 0;
 #endif
   }    
 
-#ifdef USE_CPU_CRC
+#ifdef USE_CPU_TX_CRC
   // Make sure we have enough bytes to meet minimum packet size, minus CRC
   while (tot_len < 60) {
     buf_dat = 0; // padding byte
@@ -347,7 +1009,7 @@ static uint __not_in_flash_func(ethernet_frame_copy_ring_pbuf)
   }
 #endif
 
-#ifdef USE_DMA_CRC
+#ifdef USE_DMA_TX_CRC
   // Make sure we have enough bytes to meet minimum packet size, minus CRC
   // Note that we push the fill bytes through the DMA engine in order
   // to include them in the DMA sniffer CRC calculation
@@ -385,15 +1047,22 @@ static uint __not_in_flash_func(ethernet_frame_copy_ring_pbuf)
   tot_len += 4;
 
   // Compute packet length dibits - 1 for PIO transmit loop
-  uint16_t pkt_len = (tot_len * 4) - 1;
+  uint32_t pkt_len = (tot_len * 4) - 1;
+
+  // Pad to the next word, always at least one byte. The PIO discards the
+  // rest of the last word after the frame, so it must never end up empty.
+  uint32_t pad = 4 - ((TX_FRAME_OFFSET + tot_len) & 3);
+
+  for (i = 0; i < pad; i++) {
+    data[addr] = 0;
+    addr = (addr + 1) & TX_BUF_MASK;
+  }
 
   // Save packet length for PIO transmit at start of packet
-  data[p_addr] = pkt_len;
-  p_addr = (p_addr + 1) & TX_BUF_MASK;
-  data[p_addr] = pkt_len >> 8;
+  *(volatile uint32_t *)&data[p_addr] = pkt_len;
 
-  // Add parameter len to buffer occupancy
-  tot_len += 2;
+  // Add length word, frame offset and padding to buffer occupancy
+  tot_len += 4 + TX_FRAME_OFFSET + pad;
 
   return tot_len;
 }
@@ -689,73 +1358,400 @@ void netif_rmii_ethernet_mdio_write(uint addr, uint reg, uint val) {
 
 uint32_t max_cmd = 5;
 
-// Get packet from pbuf, add CRC, put in DMA buffer for transmit
-static err_t netif_rmii_ethernet_output(struct netif *netif, struct pbuf *p) {
-  uint32_t curr_cmd;
-  uint32_t tx_next_pkt_ptr;
+#ifdef USE_SINGLE_CHAN_DMA
+// Start the packet DMA on the next command, if it's idle and there is one
+// Called by the output routine and by the DMA completion ISR, which may
+// run on different cores, so the command read pointer is spinlock protected
+static void __not_in_flash_func(tx_start_next)(void) {
+  uint32_t irq_save = spin_lock_blocking(tx_cmd_lock);
+
+#ifdef USE_PAUSE_FRAMES
+  // Held off by link partner, tx_pause_check() will restart us, or by a
+  // PAUSE frame going out, which restarts us once it's done
+  if (tx_paused || tx_pause_hold) {
+    spin_unlock(tx_cmd_lock, irq_save);
+    return;
+  }
+#endif
 
-  // Test to see if there's space in the buffer for the packet
-  // Pbuf length does not include CRC bytes, nor pkt length bytes
-  uint32_t plen = p->tot_len + 4 + 2;
+  if (!dma_channel_is_busy(tx_dma_chan)) {
+    uint32_t len = tx_pkt_ptr[tx_cmd_rd];
 
-  // Nor does it pad to minimum Ethernet frame size + pkt length bytes
-  if (plen < 66) plen = 66;
+    // Zero is end of commands
+    if (len != 0) {
+      tx_cmd_rd = (tx_cmd_rd + 1) & TX_NUM_MASK;
+      dma_channel_hw_addr(tx_dma_chan)->al1_transfer_count_trig = len;
+    }
+  }
 
-  // Make Tx read addr into ring buffer index
-  uint32_t curr_rd = (dma_hw->ch[tx_dma_chan].read_addr) & TX_BUF_MASK;
-      
-  // Get current ring buffer write address index
-  uint32_t curr_wr = tx_addr;
+  spin_unlock(tx_cmd_lock, irq_save);
+}
 
-  // Calculate free space available
-  uint32_t tx_buf_wrap = (curr_rd ^ curr_wr) & TX_BUF_MASK;
-  uint32_t tx_free = (TX_BUF_SIZE -
-		      (tx_buf_wrap ? ((curr_rd - curr_wr) & TX_BUF_MASK) :
-		       (curr_wr - curr_rd)));
+// End of TX frame DMA, replaces the TX chain channel
+static void __not_in_flash_func(netif_rmii_ethernet_tx_dma_isr)() {
 
-  // Wait for space in buffer
-  while (plen > tx_free) {
-    sleep_us(10);
-    curr_rd = (dma_hw->ch[tx_dma_chan].read_addr) & TX_BUF_MASK;
-    tx_buf_wrap = (curr_rd ^ curr_wr) & TX_BUF_MASK;
-    tx_free = (TX_BUF_SIZE -
-	       (tx_buf_wrap ? ((curr_rd - curr_wr) & TX_BUF_MASK) :
-		(curr_wr - curr_rd)));
+  // Shared IRQ, only handle our own channel
+  if (!(dma_hw->ints1 & (1u << tx_dma_chan))) return;
+
+  dma_channel_acknowledge_irq1(tx_dma_chan);
+  tx_start_next();
+}
+#endif
+
+#ifdef USE_PAUSE_FRAMES
+#ifndef USE_SINGLE_CHAN_DMA
+// Let the TX chain channel run again, after clearing EN held it off
+// If the packet channel finished a frame meanwhile, its trigger was
+// dropped, so restart the chain at the next command. A chain that stopped
+// at (or already read) the end of commands is left for tx_ring_send().
+static void tx_chain_release(void) {
+  uint32_t next = ((dma_channel_hw_addr(tx_chain_chan)->read_addr -
+		   (uint32_t)&tx_pkt_ptr[0]) >> 2) & TX_NUM_MASK;
+  uint32_t pending = (tx_curr_pkt_ptr - next) & TX_NUM_MASK;
+
+  hw_set_bits(&dma_hw->ch[tx_chain_chan].al1_ctrl, DMA_CH0_CTRL_TRIG_EN_BITS);
+
+  // Zero is the end of commands, all ones is past it
+  if (!dma_channel_is_busy(tx_dma_chan) &&
+      (pending != 0) && (pending != TX_NUM_MASK)) {
+    dma_channel_hw_addr(tx_chain_chan)->al3_read_addr_trig =
+      dma_channel_hw_addr(tx_chain_chan)->read_addr;
   }
+}
+#endif
 
-  // Push frame into ring buffer
-  uint32_t len = ethernet_frame_copy_ring_pbuf(tx_ring, p, tx_addr);
+// Hold off the TX DMA chain for the given number of pause quanta
+// Clearing EN on the chain channel makes it ignore the trigger from the
+// packet channel, so the frame on the wire completes and the next one waits
+static void tx_pause_start(uint16_t quanta) {
 
-  // Bump frame ring buffer addr
-  tx_addr = (tx_addr + len) & TX_BUF_MASK;
+  // Zero quanta is a request to resume immediately
+  if (quanta == 0) {
+    tx_pause_end_time = get_absolute_time();
+  } else {
+    tx_pause_end_time = make_timeout_time_us(PAUSE_QUANTA_TO_US(quanta));
+  }
 
-#ifdef CMD_PKT_DEBUG
-  // Get current cmd read and cmd write pointers
-  curr_cmd = ((dma_hw->ch[tx_chain_chan].read_addr) >> 2) & TX_NUM_MASK;
-  tx_next_pkt_ptr = (tx_curr_pkt_ptr + 1) & TX_NUM_MASK;
+  if (!tx_paused) {
+#ifndef USE_SINGLE_CHAN_DMA
+    hw_clear_bits(&dma_hw->ch[tx_chain_chan].al1_ctrl,
+		  DMA_CH0_CTRL_TRIG_EN_BITS);
+#endif
+    // With a single TX channel, tx_start_next() sees the flag instead
+    tx_paused = true;
+  }
+}
 
-  // Compute number of items in command buffer, including EOC
-  tx_buf_wrap = (tx_next_pkt_ptr ^ curr_cmd) & TX_NUM_MASK;
-  tx_free = (tx_buf_wrap ? ((tx_next_pkt_ptr - curr_cmd) & TX_NUM_MASK) :
-	     (tx_next_pkt_ptr - curr_cmd));
+// Restart the TX DMA chain once the pause time has expired
+static void tx_pause_check(void) {
 
-  if (tx_free > max_cmd) {
-    printf("%d ", tx_free);
-    max_cmd = tx_free;
+  if (!tx_paused) return;
+
+  if (absolute_time_diff_us(get_absolute_time(), tx_pause_end_time) > 0) {
+    return;
   }
+
+#ifdef USE_SINGLE_CHAN_DMA
+  tx_paused = false;
+  tx_start_next();
+#else
+  tx_paused = false;
+  tx_chain_release();
+#endif
+}
 #endif
 
-  // Insert new packet into command list, saving DMA status before/after
-  // Generate next packet pointer for EOC (cmd write)
-  tx_next_pkt_ptr = (tx_curr_pkt_ptr + 1) & TX_NUM_MASK;
+// Bytes in the TX ring not yet read by the packet DMA channel
+static uint32_t __not_in_flash_func(tx_ring_used)(void) {
 
-  // Put end of commands (EOC) into command ring, after new command
-  tx_pkt_ptr[tx_next_pkt_ptr] = 0;
+  // Make Tx read addr into ring buffer index
+  uint32_t curr_rd = (dma_hw->ch[tx_dma_chan].read_addr) & TX_BUF_MASK;
 
+  // Writer is always ahead of (or equal to) the reader
+  return (tx_addr - curr_rd) & TX_BUF_MASK;
+}
+
+#ifdef USE_CAPTURE
+// Check the headers of a captured frame against the filter
+static bool __not_in_flash_func(cap_match)(const uint8_t *d, uint32_t len) {
+  const netif_rmii_ethernet_capture_filter_t *f = &cap_filter;
+  uint16_t type;
+  uint32_t ihl;
+
+  if ((f->eth_type | f->ip_proto | f->port) == 0) return true;
+
+  if (len < 14) return false;
+  type = (d[12] << 8) | d[13];
+
+  if (f->eth_type && (type != f->eth_type)) return false;
+  if ((f->ip_proto | f->port) == 0) return true;
+
+  // Protocol and port only match IPv4
+  if ((type != 0x0800) || (len < 34)) return false;
+  if (f->ip_proto && (d[23] != f->ip_proto)) return false;
+  if (f->port == 0) return true;
+
+  // TCP or UDP, ports are only in the first fragment
+  if ((d[23] != 6) && (d[23] != 17)) return false;
+  if (((d[20] & 0x1f) | d[21]) != 0) return false;
+
+  ihl = (d[14] & 0x0f) << 2;
+  if (len < 14 + ihl + 4) return false;
+  d += 14 + ihl;
+
+  return ((((d[0] << 8) | d[1]) == f->port) ||
+	  (((d[2] << 8) | d[3]) == f->port));
+}
+
+// Get the next free capture slot, NULL if this direction isn't captured
+// or the ring is full
+static cap_slot_t * __not_in_flash_func(cap_slot_get)(uint8_t flags) {
+
+  if (cap_filter.dir && !(cap_filter.dir & flags)) return NULL;
+
+  if ((cap_wr - cap_rd) == CAP_NUM_SLOT) {
+    cap_drops++;
+    return NULL;
+  }
+
+  return &cap_slot[cap_wr & CAP_NUM_MASK];
+}
+
+// Hand a filled slot to the drainer, if it passes the filter
+// n bytes of the frame are in the slot, enough for the filter
+static void __not_in_flash_func(cap_slot_put)(cap_slot_t *s, uint32_t n,
+					      uint32_t len, uint8_t flags) {
+
+  if (!cap_match(s->data, n)) return;
+
+  s->time = time_us_64();
+  s->len = (n > cap_snaplen) ? cap_snaplen : n;
+  s->orig_len = len;
+  s->flags = flags;
+
+  // Slot contents must be visible before the index moves
+  __dmb();
+  cap_wr = cap_wr + 1;
+  cap_count++;
+}
+
+// Capture a received frame in the RX ring, len includes the FCS
+static void __not_in_flash_func(cap_frame_rx)(uint32_t addr, uint32_t len) {
+  cap_slot_t *s;
+  uint32_t n, n1;
+
+  if ((s = cap_slot_get(NETIF_RMII_CAPTURE_RX)) == NULL) return;
+
+  // Leave out the FCS, copy in two parts where the ring wraps
+  len -= 4;
+  n = (len > CAP_MAX_SNAPLEN) ? CAP_MAX_SNAPLEN : len;
+  n1 = RX_BUF_SIZE - addr;
+  if (n1 > n) n1 = n;
+
+  memcpy(s->data, (const uint8_t *)&rx_ring[addr], n1);
+  memcpy(s->data + n1, (const uint8_t *)&rx_ring[0], n - n1);
+
+  cap_slot_put(s, n, len, NETIF_RMII_CAPTURE_RX);
+}
+
+// Capture a frame on its way to the TX ring
+static void __not_in_flash_func(cap_frame_tx)(struct pbuf *p) {
+  cap_slot_t *s;
+  uint32_t len = p->tot_len - ETH_PAD_SIZE;
+  uint32_t n;
+
+  if ((s = cap_slot_get(NETIF_RMII_CAPTURE_TX)) == NULL) return;
+
+  n = (len > CAP_MAX_SNAPLEN) ? CAP_MAX_SNAPLEN : len;
+  pbuf_copy_partial(p, s->data, n, ETH_PAD_SIZE);
+
+  cap_slot_put(s, n, len, NETIF_RMII_CAPTURE_TX);
+}
+
+void netif_rmii_ethernet_capture_start
+     (const netif_rmii_ethernet_capture_filter_t *filter, uint snaplen) {
+
+  cap_active = false;
+
+  if (filter) {
+    cap_filter = *filter;
+  } else {
+    memset(&cap_filter, 0, sizeof(cap_filter));
+  }
+
+  cap_snaplen = ((snaplen == 0) || (snaplen > CAP_MAX_SNAPLEN)) ?
+    CAP_MAX_SNAPLEN : snaplen;
+
+  // Drainer starts the stream with fresh section and interface blocks
+  cap_new_section = true;
+
+  __dmb();
+  cap_active = true;
+}
+
+void netif_rmii_ethernet_capture_stop() {
+  cap_active = false;
+}
+
+// Print a pcapng block as a "PCAPNG <base64>" line, so it survives stdio
+// line ending translation and mixes with other output
+static void cap_print_block(const uint32_t *blk) {
+  static const char b64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  const uint8_t *b = (const uint8_t *)blk;
+  uint32_t len = blk[1];
+  uint32_t v;
+  uint32_t i;
+  char line[4 * ((CAP_MAX_SNAPLEN + 44 + 2) / 3) + 1];
+  char *c = line;
+
+  for (i = 0; i < len; i += 3) {
+    v = b[i] << 16;
+    if (i + 1 < len) v |= b[i + 1] << 8;
+    if (i + 2 < len) v |= b[i + 2];
+
+    *c++ = b64[(v >> 18) & 0x3f];
+    *c++ = b64[(v >> 12) & 0x3f];
+    *c++ = (i + 1 < len) ? b64[(v >> 6) & 0x3f] : '=';
+    *c++ = (i + 2 < len) ? b64[v & 0x3f] : '=';
+  }
+  *c = 0;
+
+  printf("PCAPNG %s\n", line);
+}
+
+// Section header and interface description blocks, microsecond timestamps
+static void cap_print_section() {
+  uint32_t shb[7] = { 0x0a0d0d0a, 28, 0x1a2b3c4d, 0x00000001,
+		      0xffffffff, 0xffffffff, 28 };
+  uint32_t idb[8] = { 0x00000001, 32,
+		      1,                   // LINKTYPE_ETHERNET
+		      CAP_MAX_SNAPLEN,
+		      0x00010009, 6,       // if_tsresol: 10^-6
+		      0,                   // opt_endofopt
+		      32 };
+
+  cap_print_block(shb);
+  cap_print_block(idb);
+}
+
+// Enhanced packet block for a captured frame
+static void cap_print_slot(const cap_slot_t *s) {
+  uint32_t blk[(44 + CAP_MAX_SNAPLEN) / 4];
+  uint32_t words = (s->len + 3) >> 2;
+  uint32_t len = 44 + (words << 2);
+  uint32_t *w = &blk[7 + words];
+
+  blk[0] = 0x00000006;
+  blk[1] = len;
+  blk[2] = 0;                            // Interface
+  blk[3] = (uint32_t)(s->time >> 32);
+  blk[4] = (uint32_t)s->time;
+  blk[5] = s->len;
+  blk[6] = s->orig_len;
+
+  // Frame, zero padded to a word
+  blk[6 + words] = 0;
+  memcpy(&blk[7], s->data, s->len);
+
+  // epb_flags: inbound 1, outbound 2
+  *w++ = 0x00040002;
+  *w++ = (s->flags & NETIF_RMII_CAPTURE_RX) ? 1 : 2;
+  *w++ = 0;                              // opt_endofopt
+  *w = len;
+
+  cap_print_block(blk);
+}
+
+uint netif_rmii_ethernet_capture_drain(uint max) {
+  uint32_t wr;
+  uint32_t rd;
+  uint n = 0;
+
+  if (cap_new_section) {
+    cap_new_section = false;
+    cap_print_section();
+  }
+
+  // Slot contents are read after the index that covers them
+  wr = cap_wr;
+  __dmb();
+
+  for (rd = cap_rd; (rd != wr) && ((max == 0) || (n < max)); rd++) {
+    cap_print_slot(&cap_slot[rd & CAP_NUM_MASK]);
+    n++;
+
+    // Done with the slot before handing it back
+    __dmb();
+    cap_rd = rd + 1;
+  }
+
+  return n;
+}
+#endif
+
+// Get packet from pbuf, add CRC, put in DMA buffer for transmit
+static err_t __not_in_flash_func(tx_ring_send)(struct netif *netif,
+					       struct pbuf *p) {
+  uint32_t curr_cmd;
+  uint32_t tx_next_pkt_ptr;
+
+  // Test to see if there's space in the buffer for the packet
+  // Pbuf length does not include CRC bytes, pkt length word, nor padding
+  uint32_t plen = TX_RING_ENTRY_LEN(p->tot_len - ETH_PAD_SIZE);
+
+  // Wait for space in buffer
+  // Keep one byte spare, so a full ring isn't mistaken for an empty one
+  while (plen >= (TX_BUF_SIZE - tx_ring_used())) {
+    sleep_us(10);
+#ifdef USE_PAUSE_FRAMES
+    // Ring can only drain if we're not being held off by the link partner
+    tx_pause_check();
+#endif
+  }
+
+#ifdef USE_CAPTURE
+  if (cap_active) cap_frame_tx(p);
+#endif
+
+  // Push frame into ring buffer
+  uint32_t len = ethernet_frame_copy_ring_pbuf(tx_ring, p, tx_addr);
+
+  // Bump frame ring buffer addr
+  tx_addr = (tx_addr + len) & TX_BUF_MASK;
+
+#ifdef CMD_PKT_DEBUG
+  // Get current cmd read and cmd write pointers
+  curr_cmd = ((dma_hw->ch[tx_chain_chan].read_addr) >> 2) & TX_NUM_MASK;
+  tx_next_pkt_ptr = (tx_curr_pkt_ptr + 1) & TX_NUM_MASK;
+
+  // Compute number of items in command buffer, including EOC
+  tx_buf_wrap = (tx_next_pkt_ptr ^ curr_cmd) & TX_NUM_MASK;
+  tx_free = (tx_buf_wrap ? ((tx_next_pkt_ptr - curr_cmd) & TX_NUM_MASK) :
+	     (tx_next_pkt_ptr - curr_cmd));
+
+  if (tx_free > max_cmd) {
+    printf("%d ", tx_free);
+    max_cmd = tx_free;
+  }
+#endif
+
+  // Insert new packet into command list, saving DMA status before/after
+  // Generate next packet pointer for EOC (cmd write)
+  tx_next_pkt_ptr = (tx_curr_pkt_ptr + 1) & TX_NUM_MASK;
+
+  // Put end of commands (EOC) into command ring, after new command
+  tx_pkt_ptr[tx_next_pkt_ptr] = 0;
+
+#ifdef USE_SINGLE_CHAN_DMA
+  // Write new command (word count), then start the packet DMA if it's idle
+  tx_pkt_ptr[tx_curr_pkt_ptr] = len >> 2;
+  tx_start_next();
+#else
   // Write new command into cmd ring buffer, with interrupts disabled
   uint32_t irq_save = save_and_disable_interrupts();
   uint32_t before_stat = dma_channel_is_busy(tx_dma_chan);
-  tx_pkt_ptr[tx_curr_pkt_ptr] = len;
+  tx_pkt_ptr[tx_curr_pkt_ptr] = len >> 2;
   uint32_t after_stat = dma_channel_is_busy(tx_dma_chan);
 
   // Sample busy again if we were busy before and not now
@@ -791,18 +1787,833 @@ static err_t netif_rmii_ethernet_output(struct netif *netif, struct pbuf *p) {
     dma_channel_hw_addr(tx_chain_chan)->al3_read_addr_trig =
       (uint32_t)&(tx_pkt_ptr[tx_curr_pkt_ptr]);
   }
+#endif
+
+  // Bump command ring buffer address
+  tx_curr_pkt_ptr = tx_next_pkt_ptr;
+
+  return ERR_OK;
+}
+
+#ifdef USE_TX_PRIORITY
+// Software TX queue, one per traffic class
+typedef struct {
+  struct pbuf *pkt[TX_QUEUE_LEN];
+  uint32_t rd;                  // Next frame to send
+  uint32_t wr;                  // Next free slot
+  uint32_t rate;                // Shaper rate in bytes/sec, 0 is unshaped
+  uint32_t burst;               // Shaper bucket size in bytes
+  uint32_t tokens;              // Bytes that may be sent now
+  absolute_time_t last_fill;    // Last time tokens were added
+} tx_queue_t;
+
+static tx_queue_t tx_queue[TX_NUM_CLASS];
+
+// Optional application classifier
+static netif_rmii_ethernet_tx_class_fn tx_app_classifier = NULL;
+
+// Pick a traffic class for an outbound frame, 0 is lowest priority
+// Ethernet header is always in the first pbuf of a chain from lwIP
+static uint tx_classify(struct pbuf *p) {
+  uint8_t *frame = (uint8_t *)p->payload + ETH_PAD_SIZE;
+  uint16_t type;
+
+  if (tx_app_classifier != NULL) {
+    int cls = tx_app_classifier(p);
+    if (cls >= 0) {
+      return (cls < TX_NUM_CLASS) ? cls : (TX_NUM_CLASS - 1);
+    }
+  }
+
+  if (p->len < ETH_PAD_SIZE + 16) return 0;
+
+  type = (frame[12] << 8) | frame[13];
+
+  switch (type) {
+    // Address resolution and time sync always go first
+  case 0x0806: // ARP
+  case 0x88f7: // PTP
+    return TX_NUM_CLASS - 1;
+
+    // 802.1Q tag, use the 3 bit PCP field
+  case 0x8100:
+    return ((frame[14] >> 5) * TX_NUM_CLASS) >> 3;
+
+    // IPv4, use the 6 bit DSCP field
+  case 0x0800:
+    return ((frame[15] >> 2) * TX_NUM_CLASS) >> 6;
+  }
+
+  return 0;
+}
+
+// Ring buffer bytes used by a frame, see tx_ring_send()
+static uint32_t tx_ring_len(struct pbuf *p) {
+  return TX_RING_ENTRY_LEN(p->tot_len - ETH_PAD_SIZE);
+}
+
+// Top up the token bucket, return true if a frame of len bytes may go now
+static bool tx_shaper_ok(tx_queue_t *q, uint32_t len) {
+
+  if (q->rate == 0) return true;
+
+  absolute_time_t now = get_absolute_time();
+  int64_t elapsed = absolute_time_diff_us(q->last_fill, now);
+
+  // Time to fill the whole bucket is enough, longer idle times would
+  // overflow the multiply. Round up so a full bucket is still reached.
+  int64_t fill_us = (((uint64_t)q->burst * 1000000) + q->rate - 1) / q->rate;
+  if (elapsed > fill_us) elapsed = fill_us;
+
+  uint64_t add = ((uint64_t)elapsed * q->rate) / 1000000;
+
+  // Only move the fill time when whole bytes were added, so slow rates
+  // still accumulate
+  if (add > 0) {
+    q->tokens = ((q->tokens + add) > q->burst) ? q->burst : (q->tokens + add);
+    q->last_fill = now;
+  }
+
+  // Let a frame larger than the bucket go once the bucket is full
+  return (q->tokens >= len) || (q->tokens == q->burst);
+}
+
+// Move frames from the software queues to the TX ring in strict priority
+// order, keeping no more than TX_HW_DEPTH bytes queued in hardware
+static void tx_sched_run(void) {
+  bool sent;
+
+  do {
+    sent = false;
+
+    for (int cls = TX_NUM_CLASS - 1; cls >= 0; cls--) {
+      tx_queue_t *q = &tx_queue[cls];
+
+      if (q->rd == q->wr) continue;
+
+      struct pbuf *p = q->pkt[q->rd];
+      uint32_t plen = tx_ring_len(p);
+
+      // A class over its rate yields to lower classes
+      if (!tx_shaper_ok(q, plen)) continue;
+
+      // Highest eligible frame must wait for the hardware to drain,
+      // don't let lower classes slip in ahead of it
+      if ((tx_ring_used() + plen) > TX_HW_DEPTH) return;
+
+      q->rd = (q->rd + 1) & TX_QUEUE_MASK;
+      q->tokens = (q->tokens > plen) ? (q->tokens - plen) : 0;
+
+      tx_ring_send(rmii_eth_netif, p);
+      pbuf_free(p);
+
+      sent = true;
+      break;
+    }
+  } while (sent);
+}
+
+// Queue a frame on its traffic class, then feed the TX ring
+static err_t tx_queue_frame(struct pbuf *p) {
+  tx_queue_t *q = &tx_queue[tx_classify(p)];
+
+  // Back pressure when the class queue is full, like a full TX ring
+  while (((q->wr + 1) & TX_QUEUE_MASK) == q->rd) {
+    tx_sched_run();
+    sleep_us(10);
+#ifdef USE_PAUSE_FRAMES
+    tx_pause_check();
+#endif
+  }
+
+  // lwIP frees its reference on return, we keep ours until sent
+  // Frames referencing volatile data have to be copied before queueing
+  if (PBUF_NEEDS_COPY(p)) {
+    p = pbuf_clone(PBUF_RAW, PBUF_RAM, p);
+    if (p == NULL) return ERR_MEM;
+  } else {
+    pbuf_ref(p);
+  }
+  q->pkt[q->wr] = p;
+  q->wr = (q->wr + 1) & TX_QUEUE_MASK;
+
+  tx_sched_run();
+
+  return ERR_OK;
+}
+
+void netif_rmii_ethernet_tx_set_classifier(netif_rmii_ethernet_tx_class_fn fn) {
+  tx_app_classifier = fn;
+}
+
+void netif_rmii_ethernet_tx_set_shaper(uint cls, uint32_t rate,
+				       uint32_t burst) {
+  if (cls >= TX_NUM_CLASS) return;
+
+  tx_queue[cls].rate = rate;
+  tx_queue[cls].burst = burst;
+  tx_queue[cls].tokens = burst;
+  tx_queue[cls].last_fill = get_absolute_time();
+}
+#endif
+
+// LWIP link output routine
+// Per-packet path, kept in SRAM along with the LWIP hot path
+static err_t __not_in_flash_func(netif_rmii_ethernet_output)
+     (struct netif *netif, struct pbuf *p) {
+#ifdef USE_TX_PRIORITY
+  return tx_queue_frame(p);
+#else
+  return tx_ring_send(netif, p);
+#endif
+}
+
+// Raw EtherType handlers, frames are handed over straight from the RX ring
+#define RAW_NUM_HANDLER 4
+
+typedef struct {
+  uint16_t type;
+  netif_rmii_ethernet_raw_fn fn;
+  void *arg;
+} raw_handler_t;
+
+static raw_handler_t raw_handler[RAW_NUM_HANDLER];
+static uint raw_num_handler = 0;
+
+// Frames handled/sent without LWIP
+uint32_t raw_rx_count = 0;
+uint32_t raw_tx_count = 0;
+
+// Datagrams sent by UDP streams
+uint32_t udp_stream_tx_count = 0;
+
+bool netif_rmii_ethernet_set_raw_handler(uint16_t type,
+					 netif_rmii_ethernet_raw_fn fn,
+					 void *arg) {
+  uint i;
+
+  for (i = 0; i < raw_num_handler; i++) {
+    if (raw_handler[i].type == type) break;
+  }
+
+  // Remove, moving the last entry into the hole
+  if (fn == NULL) {
+    if (i < raw_num_handler) {
+      raw_handler[i] = raw_handler[--raw_num_handler];
+    }
+    return true;
+  }
+
+  if (i == raw_num_handler) {
+    if (raw_num_handler == RAW_NUM_HANDLER) return false;
+    raw_num_handler++;
+  }
+
+  raw_handler[i].type = type;
+  raw_handler[i].fn = fn;
+  raw_handler[i].arg = arg;
+
+  return true;
+}
+
+// Hand a frame in the RX ring to a raw handler
+static void __not_in_flash_func(rx_raw_deliver)(netif_rmii_ethernet_raw_fn fn,
+						void *arg, uint32_t addr,
+						uint32_t len) {
+  uint32_t len1;
+
+  // Hide the FCS, split the view where the ring wraps
+  len -= 4;
+  len1 = RX_BUF_SIZE - addr;
+  if (len1 > len) len1 = len;
+
+  fn((const uint8_t *)&rx_ring[addr], len1, (const uint8_t *)&rx_ring[0],
+     len - len1, arg);
+  raw_rx_count++;
+}
+
+// Pass a frame in the RX ring to its raw handler, if there is one
+// Returns true if the frame was consumed
+static bool __not_in_flash_func(rx_raw_dispatch)(uint32_t addr, uint32_t len) {
+  uint16_t type;
+
+  if (raw_num_handler == 0) return false;
+
+  type = (rx_ring[(addr + 12) & RX_BUF_MASK] << 8) |
+    rx_ring[(addr + 13) & RX_BUF_MASK];
+
+  for (uint i = 0; i < raw_num_handler; i++) {
+    if (raw_handler[i].type != type) continue;
+
+    rx_raw_deliver(raw_handler[i].fn, raw_handler[i].arg, addr, len);
+
+    return true;
+  }
+
+  return false;
+}
+
+#ifdef USE_RX_CLASSIFIER
+bool netif_rmii_ethernet_rx_set_rules
+     (const netif_rmii_ethernet_rx_rule_t *rules, uint n) {
+
+  if (n > NETIF_RMII_RX_NUM_RULE) return false;
+
+  rx_cls_active = false;
+  rmii_ethernet_rx_cls_compile(&rx_cls, rules, n);
+  rx_cls_active = (n > 0);
+
+  return true;
+}
+
+// Queue a frame for a core. The poll loop's pbuf for the frame, if it
+// already has one, is taken over. Otherwise the frame is copied into one.
+static void __not_in_flash_func(rx_queue_frame)(rx_queue_t *q, uint32_t addr,
+						uint32_t len, struct pbuf **pp) {
+  struct pbuf *p;
+
+  if ((q->wr - q->rd) == RX_QUEUE_LEN) {
+    rx_cls_queue_drops++;
+    return;
+  }
+
+  if ((p = *pp) != NULL) {
+    *pp = NULL;
+  } else {
+    p = rx_pbuf_alloc(len + ETH_PAD_SIZE);
+    if (p == NULL) {
+      rx_cls_queue_drops++;
+      return;
+    }
+
+    ethernet_frame_to_pbuf(rx_ring, p, len + ETH_PAD_SIZE,
+			   (addr - ETH_PAD_SIZE) & RX_BUF_MASK);
+  }
+
+  // Frame in place before the consumer can see it
+  q->p[q->wr & RX_QUEUE_MASK] = p;
+  __dmb();
+  q->wr++;
+  rx_cls_queued++;
+}
+
+// Apply the rule table to a frame in the RX ring, *pp is the frame's pbuf
+// if the poll loop already has one
+// Returns true if the frame was consumed
+static bool __not_in_flash_func(rx_classify)(uint32_t addr, uint32_t len,
+					     struct pbuf **pp) {
+  const netif_rmii_ethernet_rx_rule_t *r;
+
+  r = rmii_ethernet_rx_cls_match(&rx_cls, rx_ring, RX_BUF_MASK, addr, len);
+  if (r == NULL) return false;
+
+  switch (r->action) {
+  case NETIF_RMII_RX_DROP:
+    rx_cls_drops++;
+    return true;
+
+  case NETIF_RMII_RX_RAW:
+    if (r->fn == NULL) return false;
+    rx_raw_deliver(r->fn, r->arg, addr, len);
+    return true;
+
+  case NETIF_RMII_RX_CORE0:
+  case NETIF_RMII_RX_CORE1:
+    rx_queue_frame(&rx_queue[r->action - NETIF_RMII_RX_CORE0], addr, len, pp);
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+struct pbuf *netif_rmii_ethernet_rx_dequeue() {
+  rx_queue_t *q = &rx_queue[get_core_num()];
+  struct pbuf *p;
+
+  if (q->rd == q->wr) return NULL;
+
+  // Read the frame only once it is queued, free the slot once read
+  __dmb();
+  p = q->p[q->rd & RX_QUEUE_MASK];
+  __dmb();
+  q->rd++;
+
+  return p;
+}
+#endif
+
+// Copy a complete frame (destination MAC onwards, no FCS) into the TX ring
+// Bypasses the TX priority queues, if enabled
+err_t __not_in_flash_func(netif_rmii_ethernet_send_raw)(const void *frame,
+							uint len) {
+  static struct pbuf raw_pbuf;
+#if ETH_PAD_SIZE
+  // Stands in for LWIP's padding in front of the frame
+  static struct pbuf raw_pad_pbuf;
+  static uint32_t raw_pad;
+#endif
+
+  if ((len < 14) || (len > 1514)) return ERR_ARG;
+
+  raw_pbuf.next = NULL;
+  raw_pbuf.payload = (void *)frame;
+  raw_pbuf.len = len;
+  raw_pbuf.tot_len = len;
+
+#if ETH_PAD_SIZE
+  raw_pad_pbuf.next = &raw_pbuf;
+  raw_pad_pbuf.payload = &raw_pad;
+  raw_pad_pbuf.len = ETH_PAD_SIZE;
+  raw_pad_pbuf.tot_len = ETH_PAD_SIZE + len;
+
+  tx_ring_send(rmii_eth_netif, &raw_pad_pbuf);
+#else
+  tx_ring_send(rmii_eth_netif, &raw_pbuf);
+#endif
+  raw_tx_count++;
+
+  return ERR_OK;
+}
+
+// One's complement sum folded to 16 bits
+static inline uint32_t csum_fold(uint32_t sum) {
+  sum = (sum & 0xffff) + (sum >> 16);
+  return (sum & 0xffff) + (sum >> 16);
+}
+
+// Sum of the 16 bit words at d, in memory order like LWIP_CHKSUM
+static uint32_t csum_words(const uint8_t *d, uint n) {
+  uint32_t sum = 0;
+  uint16_t w;
+
+  for (uint i = 0; i < n; i += 2) {
+    memcpy(&w, &d[i], 2);
+    sum += w;
+  }
+
+  return sum;
+}
+
+err_t netif_rmii_ethernet_udp_stream_open(netif_rmii_ethernet_udp_stream_t *s,
+					  const ip4_addr_t *dst,
+					  uint16_t dst_port,
+					  uint16_t src_port) {
+  struct netif *netif = rmii_eth_netif;
+  const ip4_addr_t *src = netif_ip4_addr(netif);
+  const ip4_addr_t *hop = dst;
+  const ip4_addr_t *arp_ip;
+  struct eth_addr *mac;
+  uint8_t *h = &s->hdr[ETH_PAD_SIZE];
+
+  if (ip4_addr_isany(src)) return ERR_CONN;
+
+  // Destination MAC: broadcast, multicast, or the next hop from ARP
+  if (ip4_addr_isbroadcast(dst, netif)) {
+    memset(&h[0], 0xff, 6);
+  } else if (ip4_addr_ismulticast(dst)) {
+    h[0] = 0x01;
+    h[1] = 0x00;
+    h[2] = 0x5e;
+    h[3] = ip4_addr2(dst) & 0x7f;
+    h[4] = ip4_addr3(dst);
+    h[5] = ip4_addr4(dst);
+  } else {
+    if (((dst->addr ^ src->addr) & netif_ip4_netmask(netif)->addr) != 0) {
+      hop = netif_ip4_gw(netif);
+
+      // Off the subnet with no gateway, ARP would never answer
+      if (ip4_addr_isany(hop)) return ERR_RTE;
+    }
+
+    if (etharp_find_addr(netif, hop, &mac, &arp_ip) < 0) {
+      etharp_request(netif, hop);
+      return ERR_INPROGRESS;
+    }
+    memcpy(&h[0], mac, 6);
+  }
+
+  memset(s->hdr, 0, ETH_PAD_SIZE);
+
+  // Ethernet
+  memcpy(&h[6], netif->hwaddr, 6);
+  h[12] = 0x08;
+  h[13] = 0x00;
+
+  // IPv4, length, ID and checksum are filled in per datagram
+  h = &s->hdr[ETH_PAD_SIZE + 14];
+  memset(h, 0, 28);
+  h[0] = 0x45;
+  h[6] = 0x40;                           // Don't fragment
+  h[8] = UDP_TTL;
+  h[9] = 17;                             // UDP
+  memcpy(&h[12], src, 4);
+  memcpy(&h[16], dst, 4);
+  s->ip_sum = csum_words(h, 20);
+
+  // UDP, length and checksum are filled in per datagram
+  h[20] = src_port >> 8;
+  h[21] = src_port;
+  h[22] = dst_port >> 8;
+  h[23] = dst_port;
+
+  // Pseudo header addresses and protocol, and the ports
+  s->udp_sum = csum_words(&h[12], 8) + lwip_htons(17) + csum_words(&h[20], 4);
+
+  s->ip_id = 0;
+
+  return ERR_OK;
+}
+
+// Frames go from the template and the caller's buffer straight into the
+// TX ring, bypassing LWIP and the TX priority queues
+err_t __not_in_flash_func(netif_rmii_ethernet_udp_stream_send)
+     (netif_rmii_ethernet_udp_stream_t *s, const void *data, uint len) {
+  static struct pbuf hdr_pbuf;
+  static struct pbuf data_pbuf;
+  const uint8_t *d = (const uint8_t *)data;
+  uint8_t *h = &s->hdr[ETH_PAD_SIZE + 14];
+  uint max = rmii_eth_netif->mtu - 28;
+  uint16_t ip_len;
+  uint16_t udp_len;
+  uint16_t sum;
+  uint n;
+
+  do {
+    n = (len > max) ? max : len;
+    udp_len = 8 + n;
+    ip_len = 20 + udp_len;
+
+    h[2] = ip_len >> 8;
+    h[3] = ip_len;
+    h[4] = s->ip_id >> 8;
+    h[5] = s->ip_id;
+
+    // Only length and ID change, the rest of the header sum is fixed
+    sum = ~csum_fold(s->ip_sum + lwip_htons(ip_len) + lwip_htons(s->ip_id));
+    memcpy(&h[10], &sum, 2);
+    s->ip_id++;
+
+    h[24] = udp_len >> 8;
+    h[25] = udp_len;
+
+    // UDP length counts twice, in the pseudo header and the UDP header
+    // inet_chksum() returns the complement of the data sum
+    sum = ~csum_fold(s->udp_sum + 2 * lwip_htons(udp_len) +
+		     (uint16_t)~inet_chksum(d, n));
+    if (sum == 0) sum = 0xffff;
+    memcpy(&h[26], &sum, 2);
+
+    hdr_pbuf.next = (n > 0) ? &data_pbuf : NULL;
+    hdr_pbuf.payload = s->hdr;
+    hdr_pbuf.len = sizeof(s->hdr);
+    hdr_pbuf.tot_len = sizeof(s->hdr) + n;
+
+    data_pbuf.next = NULL;
+    data_pbuf.payload = (void *)d;
+    data_pbuf.len = n;
+    data_pbuf.tot_len = n;
+
+    tx_ring_send(rmii_eth_netif, &hdr_pbuf);
+    udp_stream_tx_count++;
+
+    d += n;
+    len -= n;
+  } while (len > 0);
+
+  return ERR_OK;
+}
+
+#ifdef USE_ECHO_OFFLOAD
+// Update a checksum for a 16 bit word changing from old to new (RFC 1624)
+static inline uint16_t csum_update(uint16_t sum, uint16_t old, uint16_t new) {
+  return ~csum_fold((uint16_t)~sum + (uint16_t)~old + new);
+}
+
+// Fragmented echo request table, returns the entry for src/id or NULL
+static echo_frag_t *echo_frag_find(uint32_t src, uint16_t id) {
+  for (uint i = 0; i < ECHO_NUM_FRAG; i++) {
+    if (echo_frag[i].used && (echo_frag[i].src == src) &&
+	(echo_frag[i].id == id)) {
+      return &echo_frag[i];
+    }
+  }
+
+  return NULL;
+}
+
+// Turn an ARP request for our address around, in the header copy h
+// Only if LWIP already has the requester's MAC, otherwise LWIP answers it
+// and learns the MAC, ready for the traffic that usually follows
+static bool echo_arp(struct netif *netif, uint8_t *h) {
+  static const uint8_t arp_req[8] = { 0x00, 0x01, 0x08, 0x00, 6, 4, 0x00, 0x01 };
+  ip4_addr_t sender;
+  struct eth_addr *mac;
+  const ip4_addr_t *ip;
+
+  if (memcmp(&h[14], arp_req, sizeof(arp_req)) != 0) return false;
+  if (memcmp(&h[38], netif_ip4_addr(netif), 4) != 0) return false;
+
+  memcpy(&sender, &h[28], 4);
+  if ((etharp_find_addr(netif, &sender, &mac, &ip) < 0) ||
+      (memcmp(mac, &h[22], 6) != 0)) {
+    return false;
+  }
+
+  // Requester becomes the target
+  memcpy(&h[0], &h[22], 6);
+  memcpy(&h[32], &h[22], 10);
+
+  memcpy(&h[6], netif->hwaddr, 6);
+  h[21] = 0x02;
+  memcpy(&h[22], netif->hwaddr, 6);
+  memcpy(&h[28], netif_ip4_addr(netif), 4);
+
+  echo_arp_replies++;
+
+  return true;
+}
+
+// Turn an ICMP echo request to our address around, in the header copy h
+// Returns the header length to send from h, 0 if not an echo request
+static uint32_t echo_icmp(struct netif *netif, uint8_t *h, uint32_t len) {
+  uint32_t src;
+  uint16_t id;
+  uint16_t frag;
+  uint16_t ip_len;
+  uint16_t sum;
+  echo_frag_t *f;
+
+  // IPv4 without options, to us, with a good header sum
+  if ((h[14] != 0x45) || (h[23] != 1)) return 0;
+  if (memcmp(&h[30], netif_ip4_addr(netif), 4) != 0) return 0;
+  if (csum_fold(csum_words(&h[14], 20)) != 0xffff) return 0;
+
+  ip_len = (h[16] << 8) | h[17];
+  if ((ip_len < 28) || (14 + ip_len > len)) return 0;
+
+  memcpy(&src, &h[26], 4);
+  id = (h[18] << 8) | h[19];
+  frag = ((h[20] & 0x1f) << 8) | h[21];
+
+  if (frag == 0) {
+    // Echo request, its ICMP header is in this fragment
+    if ((h[34] != 8) || (h[35] != 0)) return 0;
+
+    // More fragments to follow, remember them
+    if (h[20] & 0x20) {
+      f = &echo_frag[echo_frag_next];
+      echo_frag_next = (echo_frag_next + 1) % ECHO_NUM_FRAG;
+      f->src = src;
+      f->id = id;
+      f->used = true;
+    }
+
+    // Echo reply, the ICMP sum covers all fragments but only type changes
+    sum = (h[36] << 8) | h[37];
+    sum = csum_update(sum, 0x0800, 0x0000);
+    h[34] = 0;
+    h[36] = sum >> 8;
+    h[37] = sum;
+  } else {
+    // Later fragment, only of a request whose first fragment was seen
+    if ((f = echo_frag_find(src, id)) == NULL) return 0;
+    if (!(h[20] & 0x20)) f->used = false;
+  }
+
+  // Swap addresses, the header sum doesn't change
+  memcpy(&h[0], &h[6], 6);
+  memcpy(&h[6], netif->hwaddr, 6);
+  memcpy(&h[26], &h[30], 4);
+  memcpy(&h[30], &src, 4);
+
+  // New TTL
+  sum = (h[24] << 8) | h[25];
+  sum = csum_update(sum, h[22] << 8, ICMP_TTL << 8);
+  h[22] = ICMP_TTL;
+  h[24] = sum >> 8;
+  h[25] = sum;
+
+  echo_icmp_replies++;
+
+  return (frag == 0) ? 42 : 34;
+}
+
+// Answer ARP requests and pings for our address from the RX ring
+// Returns true if the frame was consumed
+static bool __not_in_flash_func(rx_echo_offload)(uint32_t addr,
+						 uint32_t len) {
+  static uint8_t hdr[ETH_PAD_SIZE + 42] __attribute__((aligned (4)));
+  static struct pbuf hdr_pbuf;
+  static struct pbuf data_pbuf[2];
+  struct netif *netif = rmii_eth_netif;
+  uint8_t *h = &hdr[ETH_PAD_SIZE];
+  uint32_t hlen;
+  uint32_t n;
+  uint32_t len1;
+  uint16_t type;
+
+  if (!netif_is_up(netif) || ip4_addr_isany(netif_ip4_addr(netif))) {
+    return false;
+  }
+
+  // Without FCS, ARP and echo requests both have 42 bytes of headers
+  len -= 4;
+  if (len < 42) return false;
+
+  type = (rx_ring[(addr + 12) & RX_BUF_MASK] << 8) |
+    rx_ring[(addr + 13) & RX_BUF_MASK];
+  if ((type != 0x0806) && (type != 0x0800)) return false;
+
+  for (uint i = 0; i < 42; i++) {
+    h[i] = rx_ring[(addr + i) & RX_BUF_MASK];
+  }
+
+  if (type == 0x0806) {
+    if (!echo_arp(netif, h)) return false;
+    hlen = 42;
+    len = 42;
+  } else {
+    if ((hlen = echo_icmp(netif, h, len)) == 0) return false;
+    len = 14 + ((h[16] << 8) | h[17]);
+  }
 
-  // Bump command ring buffer address
-  tx_curr_pkt_ptr = tx_next_pkt_ptr;
+  // Rest of the frame straight from the RX ring, split where it wraps
+  hdr_pbuf.next = NULL;
+  hdr_pbuf.payload = hdr;
+  hdr_pbuf.len = ETH_PAD_SIZE + hlen;
+  hdr_pbuf.tot_len = ETH_PAD_SIZE + len;
+
+  n = len - hlen;
+  if (n > 0) {
+    addr = (addr + hlen) & RX_BUF_MASK;
+    len1 = RX_BUF_SIZE - addr;
+    if (len1 > n) len1 = n;
+
+    hdr_pbuf.next = &data_pbuf[0];
+    data_pbuf[0].next = (n > len1) ? &data_pbuf[1] : NULL;
+    data_pbuf[0].payload = (void *)&rx_ring[addr];
+    data_pbuf[0].len = len1;
+    data_pbuf[0].tot_len = n;
+
+    data_pbuf[1].next = NULL;
+    data_pbuf[1].payload = (void *)&rx_ring[0];
+    data_pbuf[1].len = n - len1;
+    data_pbuf[1].tot_len = n - len1;
+  }
 
-  return ERR_OK;
+  tx_ring_send(netif, &hdr_pbuf);
+
+  return true;
 }
+#endif
 
 // Do end of received packet processing
 // Time critical - must be in SRAM, otherwise we get CRC errors
+// The RX PIO program ends each frame with a zero padded partial word and
+// its running (decrementing) length counter, see rmii_ethernet_phy_rx.pio
+#ifdef USE_RX_EARLY_HDR
+// Hand the current frame's header to the early handler, once it is in the
+// RX ring
+static void __not_in_flash_func(rx_early_alarm_cb)(uint alarm) {
+  static uint8_t hdr[RX_EARLY_MAX];
+  uint32_t deadline = time_us_32() + RX_EARLY_WAIT_US;
+  uint32_t start = (rx_addr + RX_FRAME_OFFSET) & RX_BUF_MASK;
+  uint32_t need = (RX_FRAME_OFFSET + rx_early_len + 3) & ~3;
+  uint32_t written;
+  netif_rmii_ethernet_early_fn fn = rx_early_fn;
+
+  // The frame ended first, the poll loop has it
+  if ((fn == NULL) || (rx_eof_seq != rx_early_seq)) return;
+
+  // Header words written by the DMA, the alarm can be a little early
+  do {
+    written = ((uint32_t)dma_hw->ch[rx_dma_chan].write_addr -
+	       (uint32_t)&rx_ring[0] - rx_addr) & RX_BUF_MASK;
+
+    if ((int32_t)(time_us_32() - deadline) > 0) {
+      rx_early_late++;
+      return;
+    }
+  } while (written < need);
+
+  for (uint32_t i = 0; i < rx_early_len; i++) {
+    hdr[i] = rx_ring[(start + i) & RX_BUF_MASK];
+  }
+
+  rx_early_called = true;
+  rx_early_count++;
+  fn(hdr, rx_early_len, rx_early_arg);
+}
+
+// Start of frame, set the alarm for when the header is due
+static void __not_in_flash_func(rx_sof_isr)() {
+  pio_interrupt_clear(PICO_RMII_ETHERNET_PIO, 1);
+
+  rx_early_seq = rx_eof_seq;
+  rx_early_called = false;
+
+  if (hardware_alarm_set_target(rx_early_alarm,
+				make_timeout_time_us(rx_early_delay_us))) {
+    rx_early_alarm_cb(rx_early_alarm);
+  }
+}
+
+// CRC verdict for a frame that had its header handed over early
+static void __not_in_flash_func(rx_early_done)(bool crc_ok) {
+  netif_rmii_ethernet_early_done_fn fn = rx_early_done_fn;
+
+  if (fn != NULL) fn(crc_ok, rx_early_arg);
+}
+
+bool netif_rmii_ethernet_set_early_handler(uint len,
+					   netif_rmii_ethernet_early_fn fn,
+					   netif_rmii_ethernet_early_done_fn done,
+					   void *arg) {
+  if ((fn != NULL) && ((len == 0) || (len > RX_EARLY_MAX))) return false;
+
+  // Stop the SOF interrupt while the handlers change
+  pio_set_irq1_source_enabled(PICO_RMII_ETHERNET_PIO, pis_interrupt1, false);
+
+  rx_early_fn = fn;
+  rx_early_done_fn = done;
+  rx_early_arg = arg;
+  rx_early_len = len;
+
+  // Wire time of the header at 100 Mb/s, 80 ns a byte
+  rx_early_delay_us = ((len * 80) + 999) / 1000 + RX_EARLY_MARGIN_US;
+
+  if (fn != NULL) {
+    pio_interrupt_clear(PICO_RMII_ETHERNET_PIO, 1);
+    pio_set_irq1_source_enabled(PICO_RMII_ETHERNET_PIO, pis_interrupt1, true);
+  }
+
+  return true;
+}
+#endif
+
 static void __not_in_flash_func(netif_rmii_ethernet_eof_isr)() {
   uint32_t prev_rx_addr;
   uint32_t rx_packet_byte_count;
+  uint32_t trailer;
+  uint32_t total;
+  uint32_t tail;
+  uint32_t *w;
+#ifdef USE_RX_LINE_CRC
+  uint32_t crc;
+  uint32_t last;
+#endif
+#ifdef USE_RX_EARLY_HDR
+  bool early = rx_early_called;
+
+  // Too late for an early header now
+  rx_early_called = false;
+  rx_eof_seq++;
+#endif
+
+  // Let the DMA drain the FIFO, the trailer was pushed just before the IRQ
+  while (!pio_sm_is_rx_fifo_empty(PICO_RMII_ETHERNET_PIO,
+				  PICO_RMII_ETHERNET_SM_RX));
 
   // Save old write address (aka start of current packet)
   prev_rx_addr = rx_addr;
@@ -810,21 +2621,76 @@ static void __not_in_flash_func(netif_rmii_ethernet_eof_isr)() {
   // Save new write address (aka start of next packet)
   rx_addr = (uint32_t)dma_hw->ch[rx_dma_chan].write_addr-(uint32_t)&rx_ring[0];
 
-  // Do wrapped length calc
-  if (rx_addr < prev_rx_addr) {
-    rx_packet_byte_count = (RX_BUF_SIZE + rx_addr) - prev_rx_addr;
-  } else {
-    rx_packet_byte_count = rx_addr - prev_rx_addr;
+#ifdef USE_RX_LINE_CRC
+  // Latch and restart the sniffer before the next frame starts streaming.
+  // Should we be late, the next word lands in the wrong CRC, and the
+  // affected frame is dropped as a CRC error.
+  crc = dma_hw->sniff_data;
+  crc_sniff_seed_pad();
+#endif
+
+  // Exact byte count from the PIO counter
+  trailer = *(uint32_t *)&rx_ring[(rx_addr - 4) & RX_BUF_MASK];
+  rx_packet_byte_count = (rx_last_trailer - trailer) >> RX_COUNT_SHIFT;
+  rx_last_trailer = trailer;
+
+  // Frame offset, frame words, pad word and trailer must account for all
+  // DMA writes
+  total = RX_FRAME_OFFSET + rx_packet_byte_count;
+  if (((rx_addr - prev_rx_addr) & RX_BUF_MASK) != (((total >> 2) + 2) << 2)) {
+    rx_packet_byte_count = 0;
+  }
+
+  if (rx_packet_byte_count) {
+    // Shift the partial last word down, PIO shifts data in from the top
+    tail = total & 3;
+    w = (uint32_t *)&rx_ring[(prev_rx_addr + (total & ~3)) & RX_BUF_MASK];
+#ifdef USE_RX_LINE_CRC
+    last = *w;
+#endif
+    if (tail) {
+      *w >>= 32 - (tail << 3);
+    }
+
+#ifdef USE_RX_LINE_CRC
+    // The sniffer also saw the unshifted partial (or empty) last word and
+    // the trailer. Back those out, then add the partial word's frame bytes.
+    crc = crc32_unword(crc32_unword(crc, trailer), last);
+    for (uint32_t i = 0; i < tail; i++) {
+      crc = (crc >> 8) ^ crc32Lookup[(crc ^ (*w >> (i << 3))) & 0xff];
+    }
+
+    // Drop bad frames here, so the poll loop never sees them
+    if (crc != crc_check_value) {
+      rx_line_crc_drops++;
+      rx_packet_byte_count = 0;
+    }
+#endif
   }
 
   // Only save packets with good length
   if ((rx_packet_byte_count > 63) && (rx_packet_byte_count < 1519)) {
     // Save start/len in packet pointer ring buffer
-    rx_pkt_ptr[rx_curr_pkt_ptr].pkt_addr = prev_rx_addr;
+    rx_pkt_ptr[rx_curr_pkt_ptr].pkt_addr =
+      (prev_rx_addr + RX_FRAME_OFFSET) & RX_BUF_MASK;
     rx_pkt_ptr[rx_curr_pkt_ptr].pkt_len = rx_packet_byte_count;
 
+#ifdef USE_RX_EARLY_HDR
+#ifdef USE_RX_LINE_CRC
+    // CRC already checked above
+    if (early) rx_early_done(true);
+#else
+    // CRC is checked by the poll loop
+    if (early) rx_pkt_ptr[rx_curr_pkt_ptr].pkt_len |= RX_PKT_EARLY;
+#endif
+#endif
+
     // Bump pointer
     rx_curr_pkt_ptr = (rx_curr_pkt_ptr + 1) & RX_NUM_MASK;
+#ifdef USE_RX_EARLY_HDR
+  } else if (early) {
+    rx_early_done(false);
+#endif
   }
 
   // Clear PIO received packet flag
@@ -880,6 +2746,11 @@ void arch_pico_init() {
   *addr = PADS_BANK0_VOLTAGE_SELECT_VALUE_1V8 << PADS_BANK0_VOLTAGE_SELECT_LSB;
 #endif
 
+#ifdef USE_FAST_BOOT
+  // Clocks are locked once set_sys_clock_khz() returns. USB stdio
+  // enumerates in the background while the PHY comes up.
+  stdio_init_all();
+#else
   // Let clock settle
   sleep_ms(10);
 
@@ -887,6 +2758,7 @@ void arch_pico_init() {
   // RP2XXX stdio initialization takes around 2 seconds
   stdio_init_all();
   sleep_ms(2000);
+#endif
 
 }
 
@@ -945,6 +2817,104 @@ void arch_pico_info(struct netif *netif) {
 }
 
 
+// Abilities advertised during autonegotiation
+static uint phy_auto_nego_abilities() {
+  return LAN8720A_AUTO_NEGO_REG_IEEE802_3
+    // TODO: the PIO RX and TX are hardcoded to 100Mbps, make it configurable to uncomment this
+    // | LAN8720A_AUTO_NEGO_REG_10_ABI | LAN8720A_AUTO_NEGO_REG_10_FD_ABI
+    | LAN8720A_AUTO_NEGO_REG_100_ABI | LAN8720A_AUTO_NEGO_REG_100_FD_ABI
+#ifdef USE_PAUSE_FRAMES
+    // Let the link partner know we do symmetric PAUSE
+    | LAN8720A_AUTO_NEGO_REG_SYM_PAUSE
+#endif
+    ;
+}
+
+#ifdef USE_FAST_BOOT
+// Bring up the PHY, one step per call from the poll loop
+// Each step waits for its deadline and for the previous MDIO transaction
+static void phy_init_step() {
+
+  if (md_sm_busy) return;
+  if (absolute_time_diff_us(get_absolute_time(), phy_init_time) > 0) return;
+
+  switch (phy_init_state) {
+  case PHY_RESET:
+#ifdef PICO_RMII_ETHERNET_RST_PIN
+    // Allow on-board pull up to hold reset high
+    gpio_set_dir(PICO_RMII_ETHERNET_RST_PIN, GPIO_IN);
+#endif
+#ifdef PICO_RMII_ETHERNET_PWR_PIN
+    // On-board reset should deassert after 25 ms
+    gpio_put(PICO_RMII_ETHERNET_PWR_PIN, 1);
+#endif
+#ifdef PICO_RMII_ETHERNET_PHY_ADDR
+    phy_scan_addr = PICO_RMII_ETHERNET_PHY_ADDR;
+#endif
+    phy_find_time = make_timeout_time_ms(PHY_FIND_TIMEOUT_MS);
+    phy_scan_count = 0;
+    phy_init_state = PHY_FIND;
+    break;
+
+    // Keep reading reg 0 until the PHY is out of reset and answers,
+    // instead of waiting a fixed time for it to wake up
+  case PHY_FIND:
+    if (phy_read_pending) {
+      phy_read_pending = false;
+
+      if ((uint16_t)md_rd_return != 0xffff) {
+	phy_address = phy_scan_addr;
+#if defined(GENERATE_RMII_CLK) && !defined(PICO_RMII_ETHERNET_RST_PIN) && !defined(PICO_RMII_ETHERNET_PWR_PIN)
+	phy_init_state = PHY_SOFT_RESET;
+#else
+	phy_init_state = PHY_AUTO_NEGO;
+#endif
+	break;
+      }
+
+#ifndef PICO_RMII_ETHERNET_PHY_ADDR
+      phy_scan_addr = (phy_scan_addr + 1) & 31;
+#endif
+      phy_scan_count++;
+    }
+
+    // Give up once past the deadline and every address has been read
+    if ((phy_scan_count >= 32) && time_reached(phy_find_time)) {
+      printf("Failed to find a PHY register\n");
+      arch_pico_info(rmii_eth_netif);
+      phy_init_state = PHY_FAILED;
+      break;
+    }
+
+    md_sm_start(phy_scan_addr, LAN8720A_BASIC_CONTROL_REG, 0, MD_READ, 0);
+    phy_read_pending = true;
+    break;
+
+    // Limited workaround for lack of PHY reset
+  case PHY_SOFT_RESET:
+    md_sm_start(phy_address, LAN8720A_BASIC_CONTROL_REG, 0x8000, MD_WRITE, 0);
+    phy_init_time = make_timeout_time_ms(1);
+    phy_init_state = PHY_AUTO_NEGO;
+    break;
+
+  case PHY_AUTO_NEGO:
+    md_sm_start(phy_address, LAN8720A_AUTO_NEGO_REG,
+		phy_auto_nego_abilities(), MD_WRITE, 0);
+    phy_init_state = PHY_START;
+    break;
+
+  case PHY_START:
+    md_sm_start(phy_address, LAN8720A_BASIC_CONTROL_REG, 0x1000, MD_WRITE, 0);
+    phy_init_state = PHY_RUN;
+    break;
+
+  case PHY_RUN:
+  case PHY_FAILED:
+    break;
+  }
+}
+#endif
+
 static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
 
   // Prepare the interface
@@ -974,6 +2944,24 @@ static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
 
   netif->hwaddr_len = ETH_HWADDR_LEN;
 
+#ifdef USE_PAUSE_FRAMES
+  // Build PAUSE frame header: reserved multicast dest, our source address,
+  // MAC control type, and PAUSE opcode. Quanta filled in at send time.
+  static const uint8_t pause_dst[6] = {0x01, 0x80, 0xc2, 0x00, 0x00, 0x01};
+  memset(pause_frame, 0, sizeof(pause_frame));
+  memcpy(&pause_frame[ETH_PAD_SIZE + 0], pause_dst, 6);
+  memcpy(&pause_frame[ETH_PAD_SIZE + 6], netif->hwaddr, 6);
+  pause_frame[ETH_PAD_SIZE + 12] = ETH_TYPE_MAC_CONTROL >> 8;
+  pause_frame[ETH_PAD_SIZE + 13] = ETH_TYPE_MAC_CONTROL & 0xff;
+  pause_frame[ETH_PAD_SIZE + 14] = MAC_CONTROL_OP_PAUSE >> 8;
+  pause_frame[ETH_PAD_SIZE + 15] = MAC_CONTROL_OP_PAUSE & 0xff;
+#endif
+
+#if RMII_RX_PBUF_COUNT > 0
+  // Set up single segment RX pbuf pool
+  LWIP_MEMPOOL_INIT(RMII_RX_PBUF);
+#endif
+
   // Init TX command buffer
   for (int i = 0; i < TX_NUM_PTR; i++) {
     tx_pkt_ptr[i] = 0;
@@ -987,20 +2975,26 @@ static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
 
   // Configure the DMA channels
   rx_dma_chan = dma_claim_unused_channel(true);
-  rx_chain_chan = dma_claim_unused_channel(true);
   tx_dma_chan = dma_claim_unused_channel(true);
+#ifndef USE_SINGLE_CHAN_DMA
+  rx_chain_chan = dma_claim_unused_channel(true);
   tx_chain_chan = dma_claim_unused_channel(true);
+#endif
 
   // Reset them
   dma_channel_abort(rx_dma_chan);
-  dma_channel_abort(rx_chain_chan);
   dma_channel_abort(tx_dma_chan);
+#ifndef USE_SINGLE_CHAN_DMA
+  dma_channel_abort(rx_chain_chan);
   dma_channel_abort(tx_chain_chan);
+#endif
 
   dma_channel_hw_addr(rx_dma_chan)->al1_ctrl = 0;
-  dma_channel_hw_addr(rx_chain_chan)->al1_ctrl = 0;
   dma_channel_hw_addr(tx_dma_chan)->al1_ctrl = 0;
+#ifndef USE_SINGLE_CHAN_DMA
+  dma_channel_hw_addr(rx_chain_chan)->al1_ctrl = 0;
   dma_channel_hw_addr(tx_chain_chan)->al1_ctrl = 0;
+#endif
 
   // Get default config for RX receive channel
   // Defaults: 32 bit xfer, unpaced, no write inc, read inc, no chain
@@ -1020,9 +3014,36 @@ static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
 			  pio_get_dreq(PICO_RMII_ETHERNET_PIO,
 				       PICO_RMII_ETHERNET_SM_RX, false));
 
-  // Byte transfers
-  channel_config_set_transfer_data_size(&rx_dma_channel_config, DMA_SIZE_8);
+  // Word transfers, PIO autopushes 32 bits
+  channel_config_set_transfer_data_size(&rx_dma_channel_config, DMA_SIZE_32);
+
+  // Line rate stream, ahead of bulk copies in the DMA round robin
+  channel_config_set_high_priority(&rx_dma_channel_config, true);
+
+#ifdef USE_RX_LINE_CRC
+  // Build the reverse CRC table index, for the EOF ISR
+  for (int i = 0; i < 256; i++) {
+    crc32Reverse[crc32Lookup[i] >> 24] = i;
+  }
+
+  // Sniff the RX stream, the EOF ISR latches and resets the CRC per frame
+  channel_config_set_sniff_enable(&rx_dma_channel_config, true);
+  dma_sniffer_enable(rx_dma_chan, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
+  dma_sniffer_set_output_reverse_enabled(true);
+  crc_sniff_seed_pad();
+#endif
 
+#ifdef USE_SINGLE_CHAN_DMA
+  // Endless transfer count, channel runs forever without a reload
+  dma_channel_configure
+    (
+     rx_dma_chan, &rx_dma_channel_config,
+     &rx_ring[0],
+     &PICO_RMII_ETHERNET_PIO->rxf[PICO_RMII_ETHERNET_SM_RX],
+     dma_encode_endless_transfer_count(),
+     false
+     );
+#else
   // Chain to the rx reload channel to restart DMA for next packet
   channel_config_set_chain_to(&rx_dma_channel_config, rx_chain_chan);
 
@@ -1030,8 +3051,7 @@ static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
     (
      rx_dma_chan, &rx_dma_channel_config,
      &rx_ring[0],
-     // PIO fills upper byte of RX FIFO
-     ((uint8_t*)&PICO_RMII_ETHERNET_PIO->rxf[PICO_RMII_ETHERNET_SM_RX]) + 3,
+     &PICO_RMII_ETHERNET_PIO->rxf[PICO_RMII_ETHERNET_SM_RX],
      RX_BUF_SIZE * 16, // Arbitrary - just keep filling the ring
      false
      );
@@ -1055,6 +3075,7 @@ static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
 			1,
 			false
 			);
+#endif
 
   // Get default config for tx packet data DMA channel
   // Defaults: 32 bit xfer, unpaced, no write inc, read inc, no chain
@@ -1074,22 +3095,34 @@ static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
 			  pio_get_dreq(PICO_RMII_ETHERNET_PIO,
 				       PICO_RMII_ETHERNET_SM_TX, true));
 
-  // Eight bit transfers
-  channel_config_set_transfer_data_size(&tx_dma_channel_config, DMA_SIZE_8);
+  // Word transfers, TX PIO pulls 32 bits
+  channel_config_set_transfer_data_size(&tx_dma_channel_config, DMA_SIZE_32);
+
+  // Line rate stream, ahead of bulk copies in the DMA round robin
+  channel_config_set_high_priority(&tx_dma_channel_config, true);
 
+#ifndef USE_SINGLE_CHAN_DMA
   // Chain to tx command channel
   channel_config_set_chain_to(&tx_dma_channel_config, tx_chain_chan);
+#endif
 
   // Setup the DMA to send the frame via the PIO RMII tansmitter
   dma_channel_configure(
 			tx_dma_chan, &tx_dma_channel_config,
-			// PIO leaves data in upper byte of FIFO word
-			((uint8_t*)&PICO_RMII_ETHERNET_PIO->txf[PICO_RMII_ETHERNET_SM_TX]) + 3,
+			&PICO_RMII_ETHERNET_PIO->txf[PICO_RMII_ETHERNET_SM_TX],
 			&tx_ring[0],
-			1518, // Will be over-written by tx chain channel
+			1518 / 4, // Will be over-written by tx chain channel
 			false
 			);
 
+#ifdef USE_SINGLE_CHAN_DMA
+  // Start each frame from the end of the previous one's DMA
+  tx_cmd_lock = spin_lock_instance(spin_lock_claim_unused(true));
+  dma_channel_set_irq1_enabled(tx_dma_chan, true);
+  irq_add_shared_handler(DMA_IRQ_1, netif_rmii_ethernet_tx_dma_isr,
+			 PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+  irq_set_enabled(DMA_IRQ_1, true);
+#else
   // Get default config for TX chain DMA channel
   // Defaults: 32 bit xfer, unpaced, no write inc, read inc, no chain
   tx_chain_channel_config = dma_channel_get_default_config(tx_chain_chan);
@@ -1109,6 +3142,7 @@ static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
 			1, // Will be over-written by packet output routine
 			false
 			);
+#endif
 
     
 #ifdef USE_DMA_CRC
@@ -1133,12 +3167,14 @@ static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
   // Eight bit transfers
   channel_config_set_transfer_data_size(&pbuf_rx_channel_config, DMA_SIZE_8);
 
+#ifndef USE_RX_LINE_CRC
   // Select this channel for sniffing
   channel_config_set_sniff_enable(&pbuf_rx_channel_config, true);
 
   // Enable the DMA sniffer to calculate Ethernet CRC
   dma_sniffer_enable(pbuf_chan, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
   dma_sniffer_set_output_reverse_enabled(true);
+#endif
 
   // Get default config for pbuf copy DMA channel
   // Defaults: 32 bit xfer, unpaced, no write inc, read inc, no chain
@@ -1156,12 +3192,26 @@ static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
   // Eight bit transfers
   channel_config_set_transfer_data_size(&pbuf_tx_channel_config, DMA_SIZE_8);
 
+#ifndef USE_RX_LINE_CRC
   // Select this channel for sniffing
   channel_config_set_sniff_enable(&pbuf_tx_channel_config, true);
+#endif
 
   // Make a no-inc read version, for padding tx buffers
   pbuf_tx_no_inc_channel_config = pbuf_tx_channel_config;
   channel_config_set_read_increment(&pbuf_tx_no_inc_channel_config, false);
+
+  // Word versions of the copy configs, for the aligned bulk of a frame
+  pbuf_rx32_channel_config = pbuf_rx_channel_config;
+  channel_config_set_transfer_data_size(&pbuf_rx32_channel_config, DMA_SIZE_32);
+  pbuf_tx32_channel_config = pbuf_tx_channel_config;
+  channel_config_set_transfer_data_size(&pbuf_tx32_channel_config, DMA_SIZE_32);
+
+  // Sniff only versions of the RX copy configs, to check a frame with no pbuf
+  pbuf_crc_channel_config = pbuf_rx_channel_config;
+  channel_config_set_write_increment(&pbuf_crc_channel_config, false);
+  pbuf_crc32_channel_config = pbuf_rx32_channel_config;
+  channel_config_set_write_increment(&pbuf_crc32_channel_config, false);
 #endif
 
   // Run Tx PIO state machine at 2x RMII clk (i.e. 100 MHz)
@@ -1193,6 +3243,11 @@ static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
 			    PICO_RMII_ETHERNET_RX_PIN,
 			    rx_div);
 
+#ifdef USE_FAST_BOOT
+  // Reset is released by the poll loop, 25 ms from now
+  phy_init_time = make_timeout_time_ms(25);
+  phy_init_state = PHY_RESET;
+#else
 #ifdef PICO_RMII_ETHERNET_RST_PIN
   // Deassert reset after a minimum of 25 ms with the RMII clock active
   sleep_ms(25);
@@ -1205,6 +3260,7 @@ static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
   // Enable power after RMII clock is running
   // On-board reset should deassert after 25 ms
   gpio_put(PICO_RMII_ETHERNET_PWR_PIN, 1);
+#endif
 #endif
 
   // Add handler for PIO SM interrupt
@@ -1219,8 +3275,26 @@ static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
     irq_set_enabled(PIO1_IRQ_0, true);
   }
 
+#ifdef USE_RX_EARLY_HDR
+  // Start of frame on PIO IRQ 1, enabled with the early handler. The alarm
+  // interrupts this core too, so the SOF, alarm and EOF ISRs never overlap.
+  rx_early_alarm = hardware_alarm_claim_unused(true);
+  hardware_alarm_set_callback(rx_early_alarm, rx_early_alarm_cb);
+  if (PICO_RMII_ETHERNET_PIO == pio0) {
+    irq_set_exclusive_handler(PIO0_IRQ_1, rx_sof_isr);
+    irq_set_enabled(PIO0_IRQ_1, true);
+  } else {
+    irq_set_exclusive_handler(PIO1_IRQ_1, rx_sof_isr);
+    irq_set_enabled(PIO1_IRQ_1, true);
+  }
+#endif
+
   // Enable PIO RX FIFO DMA
+#ifdef USE_SINGLE_CHAN_DMA
+  dma_channel_start(rx_dma_chan);
+#else
   dma_channel_start(rx_chain_chan);
+#endif
 
 #ifdef GENERATE_MDIO_CLK
   // Setup 50 kHz clock for MDIO clock 
@@ -1243,9 +3317,19 @@ static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
   // Setup MDIO pin
   gpio_init(PICO_RMII_ETHERNET_MDIO_PIN);
 
+#ifdef USE_FAST_BOOT
+  // The rest of the PHY setup is done by the poll loop
+  return ERR_OK;
+#endif
+
   // Wait for LAN8720A to wake up
   sleep_ms(100);
 
+#ifdef PICO_RMII_ETHERNET_PHY_ADDR
+  if (netif_rmii_ethernet_mdio_read(PICO_RMII_ETHERNET_PHY_ADDR, 0) != 0xffff) {
+    phy_address = PICO_RMII_ETHERNET_PHY_ADDR;
+  }
+#else
   // Get LAN8720A PHY address by looking for a response to reg 0
   for (int i = 0; i < 32; i++) {
     if (netif_rmii_ethernet_mdio_read(i, 0) != 0xffff) {
@@ -1253,6 +3337,7 @@ static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
       break;
     }
   }
+#endif
 
   if (phy_address == 0xffff) {
     printf("Failed to find a PHY register\n");
@@ -1292,11 +3377,7 @@ static err_t netif_rmii_ethernet_low_init(struct netif *netif) {
   //    netif_rmii_ethernet_mdio_write(phy_address, LAN8720A_AUTO_NEGO_REG, 0);
 #if 1
   netif_rmii_ethernet_mdio_write(phy_address, LAN8720A_AUTO_NEGO_REG, 
-				 LAN8720A_AUTO_NEGO_REG_IEEE802_3
-				 // TODO: the PIO RX and TX are hardcoded to 100Mbps, make it configurable to uncomment this
-				 // | LAN8720A_AUTO_NEGO_REG_10_ABI | LAN8720A_AUTO_NEGO_REG_10_FD_ABI
-				 | LAN8720A_AUTO_NEGO_REG_100_ABI | LAN8720A_AUTO_NEGO_REG_100_FD_ABI
-				 );
+				 phy_auto_nego_abilities());
 #endif
 
   // Enable auto-negotiate
@@ -1334,21 +3415,312 @@ err_t netif_rmii_ethernet_init(struct netif *netif) {
   return ERR_OK;
 }
 
+#ifdef USE_PAUSE_FRAMES
+// Send a MAC control frame ahead of the frames queued in the TX ring
+// MAC control frames aren't subject to PAUSE, so this also goes out while
+// the link partner holds us off. The packet channel is stopped after the
+// frame on the wire, pointed at the frame, and put back, so this waits for
+// at most those two frames.
+static void tx_pause_frame_send(struct pbuf *p) {
+  uint32_t words;
+  uint32_t read_addr;
+
+#ifdef USE_CAPTURE
+  if (cap_active) cap_frame_tx(p);
+#endif
+
+  words = ethernet_frame_copy_ring_pbuf((volatile uint8_t *)pause_ring,
+					p, 0) >> 2;
+
+  // Stop after the frame on the wire
+#ifdef USE_SINGLE_CHAN_DMA
+  uint32_t irq_save = spin_lock_blocking(tx_cmd_lock);
+  tx_pause_hold = true;
+  spin_unlock(tx_cmd_lock, irq_save);
+#else
+  hw_clear_bits(&dma_hw->ch[tx_chain_chan].al1_ctrl,
+		DMA_CH0_CTRL_TRIG_EN_BITS);
+
+  // A command being read now still starts its frame
+  dma_channel_wait_for_finish_blocking(tx_chain_chan);
+#endif
+  dma_channel_wait_for_finish_blocking(tx_dma_chan);
+
+  read_addr = dma_channel_hw_addr(tx_dma_chan)->read_addr;
+  dma_channel_hw_addr(tx_dma_chan)->read_addr = (uint32_t)pause_ring;
+  dma_channel_hw_addr(tx_dma_chan)->al1_transfer_count_trig = words;
+  dma_channel_wait_for_finish_blocking(tx_dma_chan);
+  dma_channel_hw_addr(tx_dma_chan)->read_addr = read_addr;
+
+  // Carry on with the TX ring, unless the link partner holds us off
+#ifdef USE_SINGLE_CHAN_DMA
+  tx_pause_hold = false;
+  tx_start_next();
+#else
+  if (!tx_paused) tx_chain_release();
+#endif
+}
+
+// Send a PAUSE frame to the link partner, zero quanta means resume
+static void rx_pause_send(uint16_t quanta) {
+
+  pause_frame[ETH_PAD_SIZE + 16] = quanta >> 8;
+  pause_frame[ETH_PAD_SIZE + 17] = quanta;
+
+  pause_pbuf.next = NULL;
+  pause_pbuf.payload = pause_frame;
+  pause_pbuf.len = sizeof(pause_frame);
+  pause_pbuf.tot_len = sizeof(pause_frame);
+
+  tx_pause_frame_send(&pause_pbuf);
+  pause_tx_count++;
+}
+
+// Compare RX ring occupancy against the watermarks, pause/resume the
+// link partner as needed. Called between frames by the poll loop, so
+// a long lwIP input call is bracketed by occupancy checks.
+static void rx_flow_control(void) {
+  uint32_t pkts;
+  uint32_t bytes = 0;
+
+  // Packets waiting for service, read ISR state once
+  uint32_t safe_rx_curr_pkt_ptr = rx_curr_pkt_ptr;
+  uint32_t safe_rx_addr = *(volatile uint32_t *)&rx_addr;
+
+  pkts = (safe_rx_curr_pkt_ptr - rx_prev_pkt_ptr) & RX_NUM_MASK;
+
+  // Bytes from the oldest unserviced packet to the DMA write point
+  if (pkts) {
+    bytes = (safe_rx_addr - rx_pkt_ptr[rx_prev_pkt_ptr].pkt_addr) & RX_BUF_MASK;
+  }
+
+  if (!rx_pause_active) {
+    if ((bytes > RX_PAUSE_HIGH_BYTES) || (pkts > RX_PAUSE_HIGH_PKTS)) {
+      rx_pause_send(RX_PAUSE_QUANTA);
+      rx_pause_active = true;
+      // Refresh before the link partner's pause timer runs out
+      rx_pause_refresh_time =
+	make_timeout_time_us(PAUSE_QUANTA_TO_US(RX_PAUSE_QUANTA) / 2);
+    }
+  } else {
+    if ((bytes < RX_PAUSE_LOW_BYTES) && (pkts < RX_PAUSE_LOW_PKTS)) {
+      rx_pause_send(0);
+      rx_pause_active = false;
+    } else if (time_reached(rx_pause_refresh_time)) {
+      rx_pause_send(RX_PAUSE_QUANTA);
+      rx_pause_refresh_time =
+	make_timeout_time_us(PAUSE_QUANTA_TO_US(RX_PAUSE_QUANTA) / 2);
+    }
+  }
+}
+
+// Check for a received MAC control PAUSE frame, act on it
+// Returns true if the frame was consumed
+static bool rx_pause_frame(struct pbuf *p) {
+  uint8_t *frame = (uint8_t *)p->payload + ETH_PAD_SIZE;
+
+  if (p->len < ETH_PAD_SIZE + 18) return false;
+
+  // EtherType and opcode both fall in the first pbuf
+  if ((((frame[12] << 8) | frame[13]) != ETH_TYPE_MAC_CONTROL) ||
+      (((frame[14] << 8) | frame[15]) != MAC_CONTROL_OP_PAUSE)) {
+    return false;
+  }
+
+  tx_pause_start((frame[16] << 8) | frame[17]);
+  pause_rx_count++;
+
+  return true;
+}
+#endif
+
+#ifdef USE_RX_GRO
+// Headers of a frame that could be merged: IPv4 without options or
+// fragmentation, TCP with only ACK and maybe PSH set, and some payload.
+// Returns the TCP payload length, 0 if the frame doesn't qualify.
+static uint rx_gro_check(struct pbuf *p, uint8_t **ip, uint8_t **tcp,
+			 uint *tcp_hl) {
+  uint8_t *h = (uint8_t *)p->payload + ETH_PAD_SIZE;
+  uint ip_len;
+
+  if (p->len < ETH_PAD_SIZE + 14 + 20 + 20) return 0;
+  if ((h[12] != 0x08) || (h[13] != 0x00)) return 0;
+
+  *ip = &h[14];
+  if (((*ip)[0] != 0x45) || ((*ip)[9] != 6)) return 0;
+  if ((((*ip)[6] & 0x3f) | (*ip)[7]) != 0) return 0;
+
+  ip_len = ((*ip)[2] << 8) | (*ip)[3];
+  if (ETH_PAD_SIZE + 14 + ip_len > p->tot_len) return 0;
+
+  *tcp = &(*ip)[20];
+  *tcp_hl = ((*tcp)[12] >> 4) * 4;
+  if ((*tcp_hl < 20) || (ETH_PAD_SIZE + 14 + 20 + *tcp_hl > p->len)) {
+    return 0;
+  }
+  if (((*tcp)[13] & ~TCP_PSH) != TCP_ACK) return 0;
+  if (20 + *tcp_hl >= ip_len) return 0;
+
+  // The header sum is replaced when merging, so check it here
+  if (csum_fold(csum_words(*ip, 20)) != 0xffff) return 0;
+
+  return ip_len - 20 - *tcp_hl;
+}
+
+// TCP pseudo header and header sum
+static uint32_t rx_gro_hdr_sum(const uint8_t *ip, const uint8_t *tcp,
+			       uint tcp_hl, uint len) {
+  return csum_words(&ip[12], 8) + lwip_htons(6) +
+    lwip_htons(tcp_hl + len) + csum_words(tcp, tcp_hl);
+}
+
+// Pass the segment being built to LWIP, with its headers fixed up
+// Only called with a segment held
+static void rx_gro_flush() {
+  struct pbuf *p = rx_gro.p;
+  uint8_t *ip = (uint8_t *)p->payload + ETH_PAD_SIZE + 14;
+  uint8_t *tcp = &ip[20];
+  uint tcp_hl = (tcp[12] >> 4) * 4;
+  uint16_t sum;
+
+  rx_gro.p = NULL;
+
+  if (rx_gro.segs > 1) {
+    // New IP length and header sum
+    ip[2] = (20 + tcp_hl + rx_gro.data_len) >> 8;
+    ip[3] = 20 + tcp_hl + rx_gro.data_len;
+    ip[10] = 0;
+    ip[11] = 0;
+    sum = ~csum_fold(csum_words(ip, 20));
+    memcpy(&ip[10], &sum, 2);
+
+    // TCP sum from the headers and the payload sums of the segments
+    tcp[16] = 0;
+    tcp[17] = 0;
+    sum = ~csum_fold(rx_gro_hdr_sum(ip, tcp, tcp_hl, rx_gro.data_len) +
+		     rx_gro.data_sum);
+    memcpy(&tcp[16], &sum, 2);
+
+    rx_gro_flushes++;
+  }
+
+  if (rmii_eth_netif->input(p, rmii_eth_netif) != ERR_OK) {
+    pbuf_free(p);
+  }
+}
+
+// Merge a received frame into the segment being built, or start a new one
+// Returns false, after flushing, for frames that go straight to LWIP
+static bool __not_in_flash_func(rx_gro_input)(struct pbuf *p) {
+  uint8_t *ip;
+  uint8_t *tcp;
+  uint8_t *ip0;
+  uint8_t *tcp0;
+  uint tcp_hl;
+  uint len;
+  uint32_t seq;
+  uint32_t data_sum;
+
+  if ((len = rx_gro_check(p, &ip, &tcp, &tcp_hl)) == 0) {
+    if (rx_gro.p != NULL) rx_gro_flush();
+    return false;
+  }
+
+  memcpy(&seq, &tcp[4], 4);
+  seq = lwip_ntohl(seq);
+
+  // Payload sum, from the segment's own checksum. A bad checksum carries
+  // into the merged one, so LWIP still drops it.
+  data_sum = (uint16_t)~csum_fold(rx_gro_hdr_sum(ip, tcp, tcp_hl, len));
+
+  if (rx_gro.p != NULL) {
+    ip0 = (uint8_t *)rx_gro.p->payload + ETH_PAD_SIZE + 14;
+    tcp0 = &ip0[20];
+
+    // Same flow, next in sequence, same ACK and options, room left
+    if ((memcmp(&ip[12], &ip0[12], 8) == 0) &&
+	(memcmp(tcp, tcp0, 4) == 0) &&
+	(seq == rx_gro.seq) &&
+	(memcmp(&tcp[8], &tcp0[8], 4) == 0) &&
+	(tcp[12] == tcp0[12]) &&
+	(memcmp(&tcp[20], &tcp0[20], tcp_hl - 20) == 0) &&
+	(rx_gro.data_len + len <= RX_GRO_MAX_BYTES)) {
+
+      // Latest window and PSH
+      tcp0[13] |= tcp[13];
+      memcpy(&tcp0[14], &tcp[14], 2);
+
+      // Chain on the payload only, without the FCS
+      pbuf_realloc(p, ETH_PAD_SIZE + 14 + 20 + tcp_hl + len);
+      pbuf_remove_header(p, ETH_PAD_SIZE + 14 + 20 + tcp_hl);
+      pbuf_cat(rx_gro.p, p);
+
+      // A payload at an odd offset sums byte swapped
+      if (rx_gro.data_len & 1) {
+	data_sum = ((data_sum & 0xff) << 8) | (data_sum >> 8);
+      }
+      rx_gro.data_sum = csum_fold(rx_gro.data_sum + data_sum);
+      rx_gro.data_len += len;
+      rx_gro.seq += len;
+      rx_gro.segs++;
+      rx_gro_merged++;
+
+      if ((rx_gro.segs == RX_GRO_MAX_SEGS) || (tcp[13] & TCP_PSH)) {
+	rx_gro_flush();
+      }
+
+      return true;
+    }
+
+    rx_gro_flush();
+  }
+
+  // PSH goes straight through
+  if (tcp[13] & TCP_PSH) return false;
+
+  // Start a new segment, trimmed to the IP length
+  pbuf_realloc(p, ETH_PAD_SIZE + 14 + 20 + tcp_hl + len);
+  rx_gro.p = p;
+  rx_gro.seq = seq + len;
+  rx_gro.data_sum = data_sum;
+  rx_gro.data_len = len;
+  rx_gro.segs = 1;
+
+  return true;
+}
+#endif
+
 // Test the RX ring buffer for packets, send to LWIP if available
+// Per-packet path, kept in SRAM along with the LWIP hot path
 absolute_time_t next_mdio_time = 0;
-void netif_rmii_ethernet_poll() {
+void __not_in_flash_func(netif_rmii_ethernet_poll)() {
   uint32_t rx_packet_count;
   uint32_t rx_packet_byte_count;
   uint32_t rx_packet_addr;
   uint32_t deferred_read;
   uint16_t link_status;
+  uint32_t crc_drops = 0;
+  uint32_t nobuf_drops = 0;
 
   // Test if time to read MDIO
   absolute_time_t curr_time = get_absolute_time();
   int64_t diff_time = absolute_time_diff_us(curr_time, next_mdio_time);
+#ifdef USE_FAST_BOOT
+  // PHY still coming up, link stays down until it is done
+  if (phy_init_state != PHY_RUN) {
+    phy_init_step();
+    diff_time = 0;
+  }
+#endif
   if (diff_time < 0) {
     // Schedule next read
+#ifdef USE_FAST_BOOT
+    // Catch the link coming up quickly
+    next_mdio_time = make_timeout_time_ms(netif_is_link_up(rmii_eth_netif) ?
+					  500 : PHY_LINK_DOWN_POLL_MS);
+#else
     next_mdio_time = make_timeout_time_ms(500);
+#endif
 
     // Use non-blocking MDIO read to get link status
     deferred_read = netif_rmii_ethernet_mdio_read_nb(phy_address, 1);
@@ -1378,8 +3750,23 @@ void netif_rmii_ethernet_poll() {
     rx_packet_count = safe_rx_curr_pkt_ptr - rx_prev_pkt_ptr;
   }
 
+#ifdef USE_PAUSE_FRAMES
+  // Restart transmit if a received pause has expired
+  tx_pause_check();
+#endif
+
+#ifdef USE_TX_PRIORITY
+  // Feed the TX ring as it drains
+  tx_sched_run();
+#endif
+
   // Process all the packets outstanding
   while (rx_packet_count > 0) {
+#ifdef USE_PAUSE_FRAMES
+    // Pause or resume the link partner based on RX ring occupancy
+    rx_flow_control();
+#endif
+
     // Get current packet parameters
     rx_packet_byte_count = rx_pkt_ptr[rx_prev_pkt_ptr].pkt_len;
     rx_packet_addr = rx_pkt_ptr[rx_prev_pkt_ptr].pkt_addr;
@@ -1387,25 +3774,139 @@ void netif_rmii_ethernet_poll() {
     // Bump pkt ptr/count
     rx_prev_pkt_ptr = (rx_prev_pkt_ptr + 1) & RX_NUM_MASK;
     rx_packet_count--;
+
+#ifdef USE_RX_EARLY_HDR
+    bool early = rx_packet_byte_count & RX_PKT_EARLY;
+    rx_packet_byte_count &= ~RX_PKT_EARLY;
+#endif
       
-    struct pbuf* p = pbuf_alloc(PBUF_RAW, rx_packet_byte_count, PBUF_POOL);
+#ifdef USE_RX_LINE_CRC
+    // Length and CRC were checked by the EOF ISR, a pbuf is only needed
+    // once the frame heads for LWIP
+    struct pbuf* p = NULL;
+#else
+    // Copy the zeroed frame offset bytes as LWIP's padding, and check the
+    // CRC during the copy, so the ring is read once
+    struct pbuf* p = rx_pbuf_alloc(rx_packet_byte_count + ETH_PAD_SIZE);
+    bool crc_ok;
+
+    if (p != NULL) {
+      crc_ok = ethernet_frame_to_pbuf(rx_ring, p,
+				      rx_packet_byte_count + ETH_PAD_SIZE,
+				      (rx_packet_addr - ETH_PAD_SIZE) &
+				      RX_BUF_MASK);
+    } else {
+      // No buffer, the handlers below may still take the frame in place
+      crc_ok = ethernet_frame_crc_ok(rx_ring, rx_packet_byte_count,
+				     rx_packet_addr);
+    }
+
+    if (!crc_ok) {
+#ifdef USE_RX_EARLY_HDR
+      if (early) rx_early_done(false);
+#endif
+      if (p != NULL) pbuf_free(p);
+      crc_drops++;
+      continue;
+    }
+#endif
 
-    // Push packet from ring buffer into LWIP pbuf
-    uint32_t rx_len = ethernet_frame_to_pbuf(rx_ring,
-					     p,
-					     rx_packet_byte_count,
-					     rx_packet_addr);
+#ifdef USE_RX_EARLY_HDR
+    if (early) rx_early_done(true);
+#endif
 
-    if (rmii_eth_netif->input(p, rmii_eth_netif) != ERR_OK) {
+#ifdef USE_CAPTURE
+    if (cap_active) cap_frame_rx(rx_packet_addr, rx_packet_byte_count);
+#endif
+
+#ifdef USE_RX_CLASSIFIER
+    // Rule table actions, frames matching no rule carry on as usual
+    if (rx_cls_active &&
+	rx_classify(rx_packet_addr, rx_packet_byte_count, &p)) {
+      if (p != NULL) pbuf_free(p);
+      continue;
+    }
+#endif
+
+#ifdef USE_ECHO_OFFLOAD
+    // ARP requests and pings for us are answered here
+    if (rx_echo_offload(rx_packet_addr, rx_packet_byte_count)) {
+      if (p != NULL) pbuf_free(p);
+      continue;
+    }
+#endif
+
+    // Custom EtherTypes go to their handler, without a pbuf
+    if (rx_raw_dispatch(rx_packet_addr, rx_packet_byte_count)) {
+      if (p != NULL) pbuf_free(p);
+      continue;
+    }
+
+    if (p == NULL) {
+      p = rx_pbuf_alloc(rx_packet_byte_count + ETH_PAD_SIZE);
+
+      // No buffer, skip the frame and let the pool recover
+      if (p == NULL) {
+	nobuf_drops++;
+	continue;
+      }
+
+      // Push packet from ring buffer into LWIP pbuf
+      ethernet_frame_to_pbuf(rx_ring, p, rx_packet_byte_count + ETH_PAD_SIZE,
+			     (rx_packet_addr - ETH_PAD_SIZE) & RX_BUF_MASK);
+    }
+
+#ifdef USE_PAUSE_FRAMES
+    // MAC control frames stop here, lwIP has no use for them
+    if (rx_pause_frame(p)) {
       pbuf_free(p);
+      continue;
+    }
+#endif
+
+#ifdef USE_RX_GRO
+    // Bulk TCP is merged, and passed on when its segment is done
+    if (rx_gro_input(p)) {
+      continue;
     }
+#endif
 
-    // Indicate CRC errors
-    if (rx_len == 0) {
-      printf("*");
+    if (rmii_eth_netif->input(p, rmii_eth_netif) != ERR_OK) {
+      pbuf_free(p);
     }
   }
 
+#ifdef USE_RX_GRO
+  // Nothing is held between polls
+  if (rx_gro.p != NULL) {
+    rx_gro_flush();
+  }
+#endif
+
+#ifdef USE_RX_LINE_CRC
+  // Bad frames the EOF ISR dropped since the last poll
+  uint32_t line_crc_drops = rx_line_crc_drops;
+
+  crc_drops = line_crc_drops - rx_line_crc_seen;
+  rx_line_crc_seen = line_crc_drops;
+#endif
+
+  // Account for drops once per poll
+  if (crc_drops | nobuf_drops) {
+    rx_drop_crc += crc_drops;
+    rx_drop_nobuf += nobuf_drops;
+#if LINK_STATS
+    lwip_stats.link.chkerr += crc_drops;
+    lwip_stats.link.memerr += nobuf_drops;
+    lwip_stats.link.drop += crc_drops + nobuf_drops;
+#endif
+  }
+
+#ifdef USE_PAUSE_FRAMES
+  // Catch the ring draining to empty
+  rx_flow_control();
+#endif
+
   sys_check_timeouts();
 }
 
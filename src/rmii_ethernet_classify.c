@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2025 Rob Scott
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// RX classifier rule tables
+// The rule table is compiled into one lookup table per field, each mapping
+// a field value to the set of rules it matches. A frame's match is the AND
+// of its sets, and the first rule is the lowest set bit, so the cost per
+// frame doesn't grow with the number of rules.
+
+#include <string.h>
+
+#include "pico/platform.h"
+
+#include "rmii_ethernet_classify.h"
+
+static inline uint8_t ring_byte(const volatile uint8_t *ring, uint32_t mask,
+				uint32_t addr, uint32_t offset) {
+  return ring[(addr + offset) & mask];
+}
+
+// Rules for a field value, from its sorted entries
+static rx_cls_mask_t __not_in_flash_func(rx_cls_lookup)
+     (const rx_cls_entry_t *e, uint n, uint16_t value, rx_cls_mask_t any) {
+  uint lo = 0;
+  uint hi = n;
+
+  while (lo < hi) {
+    uint mid = (lo + hi) >> 1;
+
+    if (e[mid].value < value) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return ((lo < n) && (e[lo].value == value)) ? e[lo].rules : any;
+}
+
+// Add a rule to a field value's entry, keeping the entries sorted
+static void rx_cls_add(rx_cls_entry_t *e, uint *n, uint16_t value,
+		       rx_cls_mask_t rule) {
+  uint i;
+
+  for (i = 0; i < *n; i++) {
+    if (e[i].value == value) {
+      e[i].rules |= rule;
+      return;
+    }
+  }
+
+  for (i = *n; (i > 0) && (e[i - 1].value > value); i--) {
+    e[i] = e[i - 1];
+  }
+
+  e[i].value = value;
+  e[i].rules = rule;
+  (*n)++;
+}
+
+bool rmii_ethernet_rx_cls_compile(rx_cls_t *c,
+				  const netif_rmii_ethernet_rx_rule_t *rules,
+				  uint n) {
+
+  if (n > NETIF_RMII_RX_NUM_RULE) return false;
+
+  memset(c, 0, sizeof(*c));
+
+  for (uint i = 0; i < n; i++) {
+    const netif_rmii_ethernet_rx_rule_t *r = &rules[i];
+    rx_cls_mask_t rule = (rx_cls_mask_t)1 << i;
+
+    c->rule[i] = *r;
+
+    if (r->eth_type) {
+      rx_cls_add(c->type, &c->num_type, r->eth_type, rule);
+    } else {
+      c->type_any |= rule;
+    }
+
+    for (uint v = 0; v < 256; v++) {
+      if ((r->ip_proto == 0) || (r->ip_proto == v)) c->proto[v] |= rule;
+    }
+
+    for (int v = 0; v < 64; v++) {
+      if ((r->dscp < 0) || (r->dscp == v)) c->dscp[v] |= rule;
+    }
+
+    if (r->port) {
+      rx_cls_add(c->port, &c->num_port, r->port, rule);
+    } else {
+      c->port_any |= rule;
+    }
+
+    if ((r->ip_proto == 0) && (r->dscp < 0) && (r->port == 0)) {
+      c->non_ip |= rule;
+    }
+  }
+
+  // Wildcards match every value
+  for (uint i = 0; i < c->num_type; i++) {
+    c->type[i].rules |= c->type_any;
+  }
+
+  for (uint i = 0; i < c->num_port; i++) {
+    c->port[i].rules |= c->port_any;
+  }
+
+  return true;
+}
+
+const netif_rmii_ethernet_rx_rule_t *
+__not_in_flash_func(rmii_ethernet_rx_cls_match)
+     (const rx_cls_t *c, const volatile uint8_t *ring, uint32_t mask,
+      uint32_t addr, uint32_t len) {
+  rx_cls_mask_t m;
+  uint16_t type;
+  uint8_t proto;
+  uint32_t ihl;
+  uint32_t ports;
+
+  type = (ring_byte(ring, mask, addr, 12) << 8) |
+    ring_byte(ring, mask, addr, 13);
+  m = rx_cls_lookup(c->type, c->num_type, type, c->type_any);
+  if (m == 0) return NULL;
+
+  // IPv4 header, FCS included in len
+  if ((type == 0x0800) && (len >= 14 + 20 + 4)) {
+    proto = ring_byte(ring, mask, addr, 23);
+    m &= c->proto[proto] &
+      c->dscp[ring_byte(ring, mask, addr, 15) >> 2];
+
+    // TCP or UDP, ports are only in the first fragment
+    ihl = (ring_byte(ring, mask, addr, 14) & 0x0f) << 2;
+    ports = 14 + ihl;
+    if (((proto == 6) || (proto == 17)) && (ihl >= 20) &&
+	(((ring_byte(ring, mask, addr, 20) & 0x1f) |
+	  ring_byte(ring, mask, addr, 21)) == 0) &&
+	(len >= ports + 4 + 4)) {
+      m &= rx_cls_lookup(c->port, c->num_port,
+			 (ring_byte(ring, mask, addr, ports) << 8) |
+			 ring_byte(ring, mask, addr, ports + 1),
+			 c->port_any) |
+	rx_cls_lookup(c->port, c->num_port,
+		      (ring_byte(ring, mask, addr, ports + 2) << 8) |
+		      ring_byte(ring, mask, addr, ports + 3),
+		      c->port_any);
+    } else {
+      m &= c->port_any;
+    }
+  } else {
+    m &= c->non_ip;
+  }
+
+  if (m == 0) return NULL;
+
+  // First matching rule
+  return &c->rule[__builtin_ctz(m)];
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2025 Rob Scott
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// RX classifier rule tables (rmii_ethernet_classify.c), shared with the
+// poll loop in rmii_ethernet.c
+
+#ifndef _PICO_RMII_ETHERNET_CLASSIFY_H_
+#define _PICO_RMII_ETHERNET_CLASSIFY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rmii_ethernet/netif.h"
+
+// One bit per rule, lowest set bit is the first matching rule
+typedef uint16_t rx_cls_mask_t;
+
+#if NETIF_RMII_RX_NUM_RULE > 16
+#error "NETIF_RMII_RX_NUM_RULE rules don't fit rx_cls_mask_t"
+#endif
+
+// A field value and the rules it matches, sorted by value
+typedef struct {
+  uint16_t value;
+  rx_cls_mask_t rules;
+} rx_cls_entry_t;
+
+// Compiled rule table. Each field maps to the set of rules it matches,
+// wildcard rules included, and a frame matches the rules in all sets.
+typedef struct {
+  uint num_type;
+  rx_cls_entry_t type[NETIF_RMII_RX_NUM_RULE];
+  rx_cls_mask_t type_any;
+  rx_cls_mask_t proto[256];
+  rx_cls_mask_t dscp[64];
+  uint num_port;
+  rx_cls_entry_t port[NETIF_RMII_RX_NUM_RULE];
+  rx_cls_mask_t port_any;
+  rx_cls_mask_t non_ip;       // Rules with no IPv4 fields
+  netif_rmii_ethernet_rx_rule_t rule[NETIF_RMII_RX_NUM_RULE];
+} rx_cls_t;
+
+// Compile n rules into c
+// Returns false if there are more than NETIF_RMII_RX_NUM_RULE rules.
+bool rmii_ethernet_rx_cls_compile(rx_cls_t *c,
+				  const netif_rmii_ethernet_rx_rule_t *rules,
+				  uint n);
+
+// First rule matching the frame at addr in a ring of mask + 1 bytes, len
+// includes the FCS. NULL if no rule matches.
+const netif_rmii_ethernet_rx_rule_t *
+rmii_ethernet_rx_cls_match(const rx_cls_t *c, const volatile uint8_t *ring,
+			   uint32_t mask, uint32_t addr, uint32_t len);
+
+#endif
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2025 Rob Scott
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Persisted DHCP lease and ARP entries
+// The last lease, the gateway MAC and a few ARP entries are kept in the
+// last flash sector. On boot, DHCP resumes the lease with INIT-REBOOT (a
+// single REQUEST/ACK exchange), and the saved ARP entries are loaded once
+// the lease is confirmed, so the first packets don't wait on ARP.
+
+#include <stddef.h>
+#include <string.h>
+
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "pico/flash.h"
+#include "pico/stdlib.h"
+
+#include "lwip/dhcp.h"
+#include "lwip/etharp.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/prot/dhcp.h"
+#include "lwip/timeouts.h"
+
+#include "rmii_ethernet/netif.h"
+
+// Flash sector holding the lease record, the last one by default
+#ifndef PICO_RMII_ETHERNET_LEASE_FLASH_OFFSET
+#define PICO_RMII_ETHERNET_LEASE_FLASH_OFFSET \
+  (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+#endif
+
+#define LEASE_MAGIC   0x45534c52  // "RLSE"
+#define LEASE_VERSION 1
+
+// ARP entries saved, gateway first
+#define LEASE_NUM_ARP 4
+
+// Wait for DHCP, checked every LEASE_POLL_MS
+#define LEASE_POLL_MS 10
+
+// Save the lease this long after it is bound, once ARP has had time to
+// resolve the gateway and the first peers
+#define LEASE_SAVE_DELAY_MS 5000
+
+typedef struct {
+  ip4_addr_t ip;
+  struct eth_addr mac;
+  uint8_t pad[2];
+} lease_arp_t;
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t num_arp;
+  uint8_t hwaddr[6];      // The lease belongs to this MAC address
+  uint8_t pad[2];
+  ip4_addr_t ip;
+  ip4_addr_t mask;
+  ip4_addr_t gw;
+  lease_arp_t arp[LEASE_NUM_ARP];
+  uint32_t crc;           // Of everything above
+} lease_record_t;
+
+// Lease record from flash, valid if lease_resumed is set
+static lease_record_t lease;
+static bool lease_resumed = false;
+
+// Statistics
+uint32_t lease_saves = 0;
+uint32_t lease_save_errors = 0;
+
+static uint32_t lease_crc(const lease_record_t *r) {
+  const uint8_t *d = (const uint8_t *)r;
+  uint32_t crc = 0xffffffff;
+
+  for (uint i = 0; i < offsetof(lease_record_t, crc); i++) {
+    crc ^= d[i];
+    for (uint j = 0; j < 8; j++) {
+      crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+  }
+
+  return ~crc;
+}
+
+// Flash access, kept to these two routines
+// The host test (test/lease) supplies its own, over a fake flash sector
+#ifndef PICO_RMII_ETHERNET_LEASE_HOST_TEST
+static void lease_flash_read(lease_record_t *r) {
+  memcpy(r, (const void *)(XIP_BASE + PICO_RMII_ETHERNET_LEASE_FLASH_OFFSET),
+	 sizeof(*r));
+}
+
+// Runs with the other core locked out and interrupts disabled
+static void lease_flash_program(void *page) {
+  flash_range_erase(PICO_RMII_ETHERNET_LEASE_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+  flash_range_program(PICO_RMII_ETHERNET_LEASE_FLASH_OFFSET, page,
+		      FLASH_PAGE_SIZE);
+}
+
+static bool lease_flash_write(const lease_record_t *r) {
+  static uint8_t page[FLASH_PAGE_SIZE] __attribute__((aligned (4)));
+
+  memset(page, 0xff, sizeof(page));
+  memcpy(page, r, sizeof(*r));
+
+  return flash_safe_execute(lease_flash_program, page, 100) == PICO_OK;
+}
+#else
+static void lease_flash_read(lease_record_t *r);
+static bool lease_flash_write(const lease_record_t *r);
+#endif
+
+static bool lease_valid(const lease_record_t *r, struct netif *netif) {
+  return (r->magic == LEASE_MAGIC) && (r->version == LEASE_VERSION) &&
+    (r->num_arp <= LEASE_NUM_ARP) && (r->crc == lease_crc(r)) &&
+    (memcmp(r->hwaddr, netif->hwaddr, sizeof(r->hwaddr)) == 0);
+}
+
+// Load an ARP entry by feeding the stack an ARP reply addressed to us
+static void lease_arp_load(struct netif *netif, const lease_arp_t *a) {
+  struct pbuf *p;
+  uint8_t *f;
+
+  p = pbuf_alloc(PBUF_RAW, ETH_PAD_SIZE + 14 + 28, PBUF_RAM);
+  if (p == NULL) return;
+
+  f = (uint8_t *)p->payload + ETH_PAD_SIZE;
+
+  // Ethernet header
+  memcpy(&f[0], netif->hwaddr, 6);
+  memcpy(&f[6], &a->mac, 6);
+  f[12] = 0x08;
+  f[13] = 0x06;
+
+  // ARP reply, Ethernet/IPv4
+  f += 14;
+  f[0] = 0x00; f[1] = 0x01;
+  f[2] = 0x08; f[3] = 0x00;
+  f[4] = 6;
+  f[5] = 4;
+  f[6] = 0x00; f[7] = 0x02;
+  memcpy(&f[8], &a->mac, 6);
+  memcpy(&f[14], &a->ip, 4);
+  memcpy(&f[18], netif->hwaddr, 6);
+  memcpy(&f[24], netif_ip4_addr(netif), 4);
+
+  if (netif->input(p, netif) != ERR_OK) {
+    pbuf_free(p);
+  }
+}
+
+// Build a lease record from the bound lease and the ARP table
+static void lease_build(struct netif *netif, lease_record_t *r) {
+  ip4_addr_t *ip;
+  struct netif *arp_netif;
+  struct eth_addr *mac;
+  uint n = 0;
+
+  memset(r, 0, sizeof(*r));
+  r->magic = LEASE_MAGIC;
+  r->version = LEASE_VERSION;
+  memcpy(r->hwaddr, netif->hwaddr, sizeof(r->hwaddr));
+  ip4_addr_copy(r->ip, *netif_ip4_addr(netif));
+  ip4_addr_copy(r->mask, *netif_ip4_netmask(netif));
+  ip4_addr_copy(r->gw, *netif_ip4_gw(netif));
+
+  // Gateway first, then whatever else is in the table
+  for (size_t i = 0; i < ARP_TABLE_SIZE; i++) {
+    if (!etharp_get_entry(i, &ip, &arp_netif, &mac)) continue;
+    if (arp_netif != netif) continue;
+
+    if (ip->addr == r->gw.addr) {
+      // Drop the last entry if full, to make room
+      if (n == LEASE_NUM_ARP) n--;
+      r->arp[n] = r->arp[0];
+      ip4_addr_copy(r->arp[0].ip, *ip);
+      r->arp[0].mac = *mac;
+      n++;
+    } else if (n < LEASE_NUM_ARP) {
+      ip4_addr_copy(r->arp[n].ip, *ip);
+      r->arp[n].mac = *mac;
+      n++;
+    }
+  }
+
+  r->num_arp = n;
+  r->crc = lease_crc(r);
+}
+
+void netif_rmii_ethernet_lease_save(struct netif *netif) {
+  static lease_record_t r;
+  static lease_record_t old;
+
+  if (!dhcp_supplied_address(netif)) return;
+
+  lease_build(netif, &r);
+
+  // Spare the flash if nothing changed
+  lease_flash_read(&old);
+  if (memcmp(&r, &old, sizeof(r)) == 0) return;
+
+  if (lease_flash_write(&r)) {
+    lease_saves++;
+  } else {
+    lease_save_errors++;
+  }
+}
+
+static void lease_save_timeout(void *arg) {
+  netif_rmii_ethernet_lease_save((struct netif *)arg);
+}
+
+// Wait for DHCP to bind, then load the saved ARP entries on the same subnet
+// Only if the saved lease was confirmed. After a NAK or a timeout DHCP may
+// have bound another address, maybe on another LAN using the same subnet,
+// where the saved gateway MAC would black-hole traffic until it aged out.
+static void lease_poll_timeout(void *arg) {
+  struct netif *netif = (struct netif *)arg;
+  const ip4_addr_t *ip;
+  const ip4_addr_t *mask;
+
+  if (!dhcp_supplied_address(netif)) {
+    sys_timeout(LEASE_POLL_MS, lease_poll_timeout, netif);
+    return;
+  }
+
+  ip = netif_ip4_addr(netif);
+  mask = netif_ip4_netmask(netif);
+
+  if (lease_resumed && (ip->addr == lease.ip.addr) &&
+      (netif_ip4_gw(netif)->addr == lease.gw.addr)) {
+    for (uint i = 0; i < lease.num_arp; i++) {
+      if (((lease.arp[i].ip.addr ^ ip->addr) & mask->addr) == 0) {
+	lease_arp_load(netif, &lease.arp[i]);
+      }
+    }
+  }
+
+  sys_timeout(LEASE_SAVE_DELAY_MS, lease_save_timeout, netif);
+}
+
+err_t netif_rmii_ethernet_dhcp_resume(struct netif *netif) {
+  struct dhcp *dhcp;
+  err_t err;
+
+  lease_flash_read(&lease);
+  lease_resumed = lease_valid(&lease, netif);
+
+  if ((err = dhcp_start(netif)) != ERR_OK) return err;
+
+  // With the link down, DHCP waits in INIT for the link to come up. From
+  // REBOOTING, link up sends a REQUEST for the saved address instead of
+  // a DISCOVER. A NAK, or no answer, falls back to DISCOVER.
+  dhcp = netif_dhcp_data(netif);
+  if (lease_resumed && !netif_is_link_up(netif) &&
+      (dhcp->state == DHCP_STATE_INIT)) {
+    ip4_addr_copy(dhcp->offered_ip_addr, lease.ip);
+    ip4_addr_copy(dhcp->offered_sn_mask, lease.mask);
+    ip4_addr_copy(dhcp->offered_gw_addr, lease.gw);
+    dhcp->state = DHCP_STATE_REBOOTING;
+  }
+
+  sys_timeout(LEASE_POLL_MS, lease_poll_timeout, netif);
+
+  return ERR_OK;
+}
@@ -0,0 +1,320 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2025 Rob Scott
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Host check for src/lwip/chksum.S, without hardware or an ARM toolchain
+#
+# Preprocesses chksum.S for the Cortex-M0+ (__ARM_ARCH_6M__) and Cortex-M33
+# (__ARM_ARCH_8M_MAIN__) variants, interprets the Thumb instructions it
+# uses, and compares the result with LWIP's C algorithm 2 over random
+# lengths, start alignments and contents. Also prints a cycle estimate per
+# byte for a full size frame, from the cores' documented instruction
+# timings.
+#
+#   chksum_sim.py [--cc gcc] [--iterations N] chksum.S
+
+import argparse
+import random
+import re
+import subprocess
+import sys
+
+M = 0xffffffff
+
+# Cycles per instruction, the same on both cores in the Cortex-M0+ and M33
+# technical reference manuals for what chksum.S uses. n is the number of
+# registers moved, a taken branch includes the pipeline refill.
+TIMING = {'ldm': lambda n: 1 + n, 'push': lambda n: 1 + n,
+          'pop': lambda n: 1 + n, 'pop_pc': lambda n: 3 + n,
+          'ldr': 2, 'branch': 2, 'bx': 2, 'other': 1}
+
+VARIANTS = (('__ARM_ARCH_6M__', 'Cortex-M0+'),
+            ('__ARM_ARCH_8M_MAIN__', 'Cortex-M33'))
+
+
+def preprocess(cc, source, arch):
+    out = subprocess.run([cc, '-E', '-P', '-x', 'assembler-with-cpp',
+                          '-D' + arch, source],
+                         capture_output=True, text=True, check=True).stdout
+    prog = []
+    labels = {}
+
+    for line in out.splitlines():
+        line = line.split('//')[0].strip()
+        if not line or line.startswith('.'):
+            continue
+
+        m = re.match(r'^(\w+):\s*(.*)$', line)
+        if m:
+            labels.setdefault(m.group(1), []).append(len(prog))
+            line = m.group(2).strip()
+            if not line:
+                continue
+
+        op, _, args = line.partition(' ')
+        args = args.strip()
+        prog.append((op.strip(),
+                     [a.strip() for a in re.split(r',(?![^{]*})', args)]
+                     if args else []))
+
+    if 'rmii_ethernet_chksum' not in labels:
+        sys.exit('%s: no rmii_ethernet_chksum for %s' % (source, arch))
+
+    return prog, labels
+
+
+def reg_list(s):
+    regs = []
+
+    for r in s.strip('{}').split(','):
+        r = r.strip()
+        if '-' in r:
+            a, b = r.split('-')
+            regs += ['r%d' % i for i in range(int(a[1:]), int(b[1:]) + 1)]
+        else:
+            regs.append(r)
+
+    return regs
+
+
+def run(prog, labels, timing, mem, base, r0, r1):
+    """Call rmii_ethernet_chksum(r0, r1), returns (r0, cycles)"""
+    R = {'r%d' % i: 0 for i in range(13)}
+    R.update(r0=r0, r1=r1, sp=0x20040000, lr=0xdead)
+    alias = {'ip': 'r12'}
+    F = {'N': 0, 'Z': 0, 'C': 0, 'V': 0}
+    stack = {}
+    cycles = 0
+
+    def get(r):
+        return R[alias.get(r, r)]
+
+    def put(r, v):
+        R[alias.get(r, r)] = v & M
+
+    def val(a):
+        return int(a[1:], 0) if a.startswith('#') else get(a)
+
+    def load(addr, n):
+        return int.from_bytes(mem[addr - base:addr - base + n], 'little')
+
+    def nz(v):
+        F['N'] = v >> 31
+        F['Z'] = int(v == 0)
+
+    def sub_flags(x, y):
+        t = (x - y) & M
+        sx = x - (1 << 32) if x >> 31 else x
+        sy = y - (1 << 32) if y >> 31 else y
+        nz(t)
+        F['C'] = int(x >= y)
+        F['V'] = int(not (-2**31 <= sx - sy < 2**31))
+        return t
+
+    def target(t, pc):
+        found = labels[t[:-1]]
+        if t[-1] == 'f':
+            return min(x for x in found if x >= pc)
+        return max(x for x in found if x < pc)
+
+    pc = labels['rmii_ethernet_chksum'][0]
+    it = None
+
+    while True:
+        op, a = prog[pc]
+        pc += 1
+
+        # Single instruction IT block, only "ne" is used
+        if it is not None:
+            cond, it = it, None
+            assert cond == 'ne'
+            cycles += timing['other']
+            if F['Z']:
+                continue
+            op = op[:-2]
+
+        if op in ('b', 'bgt', 'blt', 'beq', 'bne', 'bcc'):
+            taken = {'b': True,
+                     'bgt': F['Z'] == 0 and F['N'] == F['V'],
+                     'blt': F['N'] != F['V'],
+                     'beq': F['Z'] == 1,
+                     'bne': F['Z'] == 0,
+                     'bcc': F['C'] == 0}[op]
+            if taken:
+                pc = target(a[0], pc)
+                cycles += timing['branch']
+            else:
+                cycles += timing['other']
+            continue
+
+        if op == 'bx':
+            return R['r0'], cycles + timing['bx']
+
+        if op == 'push':
+            regs = reg_list(a[0])
+            for r in reversed(regs):
+                R['sp'] -= 4
+                stack[R['sp']] = get(r)
+            cycles += timing['push'](len(regs))
+            continue
+
+        if op == 'pop':
+            regs = reg_list(a[0])
+            for r in regs:
+                v = stack[R['sp']]
+                R['sp'] += 4
+                if r == 'pc':
+                    return R['r0'], cycles + timing['pop_pc'](len(regs))
+                put(r, v)
+            cycles += timing['pop'](len(regs))
+            continue
+
+        if op in ('ldrb', 'ldrh', 'ldr'):
+            n = {'ldrb': 1, 'ldrh': 2, 'ldr': 4}[op]
+            base_reg = re.match(r'\[(\w+)\]', a[1]).group(1)
+            addr = get(base_reg)
+            assert addr % n == 0, 'unaligned %s at 0x%x' % (op, addr)
+            put(a[0], load(addr, n))
+            if len(a) > 2:
+                put(base_reg, addr + int(a[2][1:]))
+            cycles += timing['ldr']
+            continue
+
+        if op == 'ldmia':
+            base_reg = a[0].rstrip('!')
+            addr = get(base_reg)
+            assert addr % 4 == 0, 'unaligned ldmia at 0x%x' % addr
+            regs = reg_list(a[1])
+            for r in regs:
+                put(r, load(addr, 4))
+                addr += 4
+            put(base_reg, addr)
+            cycles += timing['ldm'](len(regs))
+            continue
+
+        cycles += timing['other']
+
+        if op == 'cmp':
+            sub_flags(get(a[0]), val(a[1]))
+        elif op in ('mov', 'movs'):
+            v = val(a[1])
+            put(a[0], v)
+            if op == 'movs':
+                nz(v)
+        elif op in ('lsls', 'lsrs', 'lsr'):
+            x, n = (get(a[1]), int(a[2][1:])) if len(a) == 3 \
+                else (get(a[0]), int(a[1][1:]))
+            if op == 'lsls':
+                v = (x << n) & M
+                if n:
+                    F['C'] = (x >> (32 - n)) & 1
+            else:
+                v = x >> n
+                if n and op == 'lsrs':
+                    F['C'] = (x >> (n - 1)) & 1
+            put(a[0], v)
+            if op != 'lsr':
+                nz(v)
+        elif op in ('adds', 'adcs', 'adc', 'add', 'subs', 'and'):
+            if len(a) == 2:
+                x, y = get(a[0]), val(a[1])
+            else:
+                x, y = get(a[1]), val(a[2])
+                if len(a) > 3:
+                    y = (y << int(a[3].split('#')[1])) & M
+            if op == 'and':
+                put(a[0], x & y)
+            elif op == 'subs':
+                put(a[0], sub_flags(x, y))
+            else:
+                t = x + y + (F['C'] if op in ('adcs', 'adc') else 0)
+                put(a[0], t)
+                if op in ('adds', 'adcs'):
+                    nz(t & M)
+                    F['C'] = int(t > M)
+        elif op == 'eors':
+            v = get(a[0]) ^ get(a[1])
+            put(a[0], v)
+            nz(v)
+        elif op in ('tst', 'teq'):
+            nz(get(a[0]) & val(a[1]) if op == 'tst' else get(a[0]) ^ val(a[1]))
+        elif op == 'uxth':
+            put(a[0], get(a[1]) & 0xffff)
+        elif op == 'rev16':
+            x = get(a[1])
+            put(a[0], ((x & 0x00ff00ff) << 8) | ((x >> 8) & 0x00ff00ff))
+        elif op == 'it':
+            it = a[0]
+        else:
+            sys.exit('unsupported instruction: %s' % op)
+
+
+def lwip_chksum(data, addr):
+    """LWIP_CHKSUM_ALGORITHM 2 (lwip_standard_chksum) on a little endian CPU"""
+    odd = addr & 1
+    total = 0
+    t = 0
+    i = 0
+    n = len(data)
+
+    if odd and n > 0:
+        t = data[0] << 8
+        i = 1
+
+    while n - i > 1:
+        total += data[i] | (data[i + 1] << 8)
+        i += 2
+
+    if n - i > 0:
+        t |= data[i]
+
+    total += t
+    total = (total >> 16) + (total & 0xffff)
+    total = (total >> 16) + (total & 0xffff)
+
+    if odd:
+        total = ((total & 0xff) << 8) | ((total & 0xff00) >> 8)
+
+    return total & 0xffff
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--cc', default='gcc')
+    ap.add_argument('--iterations', type=int, default=2000)
+    ap.add_argument('source')
+    args = ap.parse_args()
+
+    base = 0x20000000
+
+    for arch, name in VARIANTS:
+        prog, labels = preprocess(args.cc, args.source, arch)
+        rng = random.Random(1)
+
+        for _ in range(args.iterations):
+            size = rng.choice((rng.randint(0, 80), rng.randint(0, 1600)))
+            off = rng.randint(0, 7)
+            kind = rng.random()
+            if kind < 0.15:
+                mem = bytes([0xff]) * (size + 16)
+            elif kind < 0.25:
+                mem = bytes(size + 16)
+            else:
+                mem = bytes(rng.getrandbits(8) for _ in range(size + 16))
+
+            got, _ = run(prog, labels, TIMING, mem, base, base + off, size)
+            exp = lwip_chksum(mem[off:off + size], base + off)
+            if got != exp:
+                sys.exit('%s: %d bytes at offset %d gave 0x%04x, not 0x%04x'
+                         % (name, size, off, got, exp))
+
+        mem = bytes(rng.getrandbits(8) for _ in range(1536))
+        _, cycles = run(prog, labels, TIMING, mem, base, base, 1500)
+        print('%s: %d cases match, ~%.2f cycles/byte for 1500 bytes'
+              % (name, args.iterations, cycles / 1500))
+
+
+if __name__ == '__main__':
+    main()
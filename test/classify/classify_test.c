@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2025 Rob Scott
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Host test for rmii_ethernet_classify.c
+// Random rule tables and random frames, from a small set of field values so
+// they often match, are classified by the compiled tables and by trying the
+// rules one by one. Frames are placed anywhere in a ring the size of the
+// driver's, so their headers also wrap it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/rmii_ethernet_classify.c"
+
+#define RING_SIZE 4096
+#define RING_MASK (RING_SIZE - 1)
+
+#define ITERATIONS 200000
+
+static int failures = 0;
+
+#define CHECK(cond) do {						\
+    if (!(cond)) {							\
+      printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);		\
+      failures++;							\
+    }									\
+  } while (0)
+
+static uint8_t ring[RING_SIZE];
+
+static const uint16_t types[] = { 0x0800, 0x0806, 0x86dd, 0x88b5 };
+static const uint8_t protos[] = { 1, 6, 17, 47 };
+static const int8_t dscps[] = { 0, 10, 46, 63 };
+static const uint16_t ports[] = { 53, 80, 443, 5000 };
+
+#define PICK(a) ((a)[rand() % (sizeof(a) / sizeof((a)[0]))])
+
+static uint8_t frame_byte(uint32_t addr, uint32_t offset) {
+  return ring[(addr + offset) & RING_MASK];
+}
+
+static uint16_t frame_u16(uint32_t addr, uint32_t offset) {
+  return (frame_byte(addr, offset) << 8) | frame_byte(addr, offset + 1);
+}
+
+// The rule semantics in rmii_ethernet/netif.h, one rule at a time
+static bool rule_matches(const netif_rmii_ethernet_rx_rule_t *r,
+			 uint32_t addr, uint32_t len) {
+  uint16_t type = frame_u16(addr, 12);
+  bool ip = (type == 0x0800) && (len >= 14 + 20 + 4);
+  uint8_t proto;
+  uint32_t ihl;
+
+  if (r->eth_type && (r->eth_type != type)) return false;
+
+  // Protocol, DSCP and port only match IPv4
+  if ((r->ip_proto == 0) && (r->dscp < 0) && (r->port == 0)) return true;
+  if (!ip) return false;
+
+  proto = frame_byte(addr, 23);
+  if (r->ip_proto && (r->ip_proto != proto)) return false;
+  if ((r->dscp >= 0) && (r->dscp != (frame_byte(addr, 15) >> 2))) {
+    return false;
+  }
+
+  if (r->port == 0) return true;
+
+  // Ports are in the first fragment of TCP and UDP, if the frame has them
+  ihl = (frame_byte(addr, 14) & 0x0f) * 4;
+  if (((proto != 6) && (proto != 17)) || (ihl < 20) ||
+      (frame_u16(addr, 20) & 0x1fff) || (len < 14 + ihl + 4 + 4)) {
+    return false;
+  }
+
+  return (frame_u16(addr, 14 + ihl) == r->port) ||
+    (frame_u16(addr, 14 + ihl + 2) == r->port);
+}
+
+static void random_rule(netif_rmii_ethernet_rx_rule_t *r) {
+  memset(r, 0, sizeof(*r));
+  r->eth_type = (rand() & 1) ? PICK(types) : 0;
+  r->ip_proto = (rand() & 1) ? PICK(protos) : 0;
+  r->dscp = (rand() & 1) ? PICK(dscps) : -1;
+  r->port = (rand() & 1) ? PICK(ports) : 0;
+  r->action = rand() % 5;
+}
+
+// A frame at a random ring address, returns its length with the FCS
+static uint32_t random_frame(uint32_t addr) {
+  uint32_t len = 60 + (rand() % 40);
+  uint32_t ihl = (rand() % 8) ? 5 + (rand() % 3) : rand() % 5;
+
+  // Short frames, to reach the length checks
+  if ((rand() % 8) == 0) len = 14 + (rand() % 40);
+
+  for (uint32_t i = 0; i < len; i++) {
+    ring[(addr + i) & RING_MASK] = rand();
+  }
+
+  ring[(addr + 12) & RING_MASK] = PICK(types) >> 8;
+  ring[(addr + 13) & RING_MASK] = PICK(types) & 0xff;
+  ring[(addr + 14) & RING_MASK] = 0x40 | ihl;
+  ring[(addr + 15) & RING_MASK] = (PICK(dscps) << 2) | (rand() & 3);
+  ring[(addr + 23) & RING_MASK] = PICK(protos);
+
+  // Mostly first fragments
+  if (rand() % 4) {
+    ring[(addr + 20) & RING_MASK] &= 0xe0;
+    ring[(addr + 21) & RING_MASK] = 0;
+  }
+
+  for (uint32_t i = 0; i < 2; i++) {
+    uint16_t port = (rand() % 4) ? PICK(ports) : rand();
+    uint32_t offset = 14 + (ihl * 4) + (i * 2);
+
+    ring[(addr + offset) & RING_MASK] = port >> 8;
+    ring[(addr + offset + 1) & RING_MASK] = port & 0xff;
+  }
+
+  return len;
+}
+
+static void test_random() {
+  static rx_cls_t c;
+  netif_rmii_ethernet_rx_rule_t rules[NETIF_RMII_RX_NUM_RULE];
+  uint n = 0;
+  uint matched = 0;
+
+  printf("random rules and frames\n");
+
+  for (uint i = 0; i < ITERATIONS; i++) {
+    // New table now and then, every size up to a full one
+    if ((i % 100) == 0) {
+      n = rand() % (NETIF_RMII_RX_NUM_RULE + 1);
+      for (uint j = 0; j < n; j++) {
+	random_rule(&rules[j]);
+      }
+      CHECK(rmii_ethernet_rx_cls_compile(&c, rules, n));
+    }
+
+    uint32_t addr = rand() & RING_MASK;
+    uint32_t len = random_frame(addr);
+    const netif_rmii_ethernet_rx_rule_t *got =
+      rmii_ethernet_rx_cls_match(&c, ring, RING_MASK, addr, len);
+    int exp = -1;
+
+    for (uint j = 0; j < n; j++) {
+      if (rule_matches(&rules[j], addr, len)) {
+	exp = j;
+	break;
+      }
+    }
+
+    if (exp < 0) {
+      CHECK(got == NULL);
+    } else {
+      CHECK(got == &c.rule[exp]);
+      matched++;
+    }
+
+    if (failures) {
+      printf("  %u rules, frame of %u bytes at 0x%03x\n", n, len, addr);
+      return;
+    }
+  }
+
+  printf("  %u of %u frames matched a rule\n", matched, ITERATIONS);
+}
+
+static void test_last_rule() {
+  static rx_cls_t c;
+  netif_rmii_ethernet_rx_rule_t rules[NETIF_RMII_RX_NUM_RULE];
+  uint32_t len;
+
+  printf("full table, last rule\n");
+
+  // Only the last rule matches ARP, so it needs the mask's top bit
+  for (uint i = 0; i < NETIF_RMII_RX_NUM_RULE; i++) {
+    memset(&rules[i], 0, sizeof(rules[i]));
+    rules[i].eth_type = 0x88b5;
+    rules[i].dscp = -1;
+  }
+  rules[NETIF_RMII_RX_NUM_RULE - 1].eth_type = 0x0806;
+
+  CHECK(rmii_ethernet_rx_cls_compile(&c, rules, NETIF_RMII_RX_NUM_RULE));
+  CHECK(!rmii_ethernet_rx_cls_compile(&c, rules, NETIF_RMII_RX_NUM_RULE + 1));
+  CHECK(rmii_ethernet_rx_cls_compile(&c, rules, NETIF_RMII_RX_NUM_RULE));
+
+  // EtherType split across the ring wrap
+  len = random_frame(RING_SIZE - 13);
+  ring[RING_MASK] = 0x08;
+  ring[0] = 0x06;
+
+  CHECK(rmii_ethernet_rx_cls_match(&c, ring, RING_MASK, RING_SIZE - 13, len) ==
+	&c.rule[NETIF_RMII_RX_NUM_RULE - 1]);
+}
+
+int main() {
+  srand(1);
+
+  test_random();
+  test_last_rule();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+
+  printf("all passed\n");
+  return 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2025 Rob Scott
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Host stand-ins for the SDK and LWIP parts rmii_ethernet_classify.c uses
+// Every SDK/LWIP header it includes resolves to this one.
+
+#ifndef _CLASSIFY_HOST_H_
+#define _CLASSIFY_HOST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+// SDK
+#define __not_in_flash_func(func) func
+
+// LWIP, only as far as rmii_ethernet/netif.h needs it
+typedef int8_t err_t;
+
+#define ETH_PAD_SIZE 2
+
+typedef struct {
+  uint32_t addr;
+} ip4_addr_t;
+
+struct pbuf;
+struct netif;
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2025 Rob Scott
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Host stand-ins for the SDK and LWIP parts rmii_ethernet_lease.c uses
+// Every SDK/LWIP header it includes resolves to this one.
+
+#ifndef _LEASE_HOST_H_
+#define _LEASE_HOST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+// SDK
+#define PICO_OK 0
+#define FLASH_PAGE_SIZE 256
+#define FLASH_SECTOR_SIZE 4096
+
+// LWIP basics
+typedef int8_t err_t;
+#define ERR_OK 0
+#define ERR_MEM -1
+
+#define ETH_PAD_SIZE 2
+#define ARP_TABLE_SIZE 10
+
+typedef struct {
+  uint32_t addr;
+} ip4_addr_t;
+
+#define ip4_addr_copy(dest, src) ((dest).addr = (src).addr)
+
+struct eth_addr {
+  uint8_t addr[6];
+};
+
+// pbuf, malloc backed
+typedef enum { PBUF_RAW } pbuf_layer;
+typedef enum { PBUF_RAM } pbuf_type;
+
+struct pbuf {
+  struct pbuf *next;
+  void *payload;
+  uint16_t tot_len;
+  uint16_t len;
+};
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, uint16_t len, pbuf_type type);
+uint8_t pbuf_free(struct pbuf *p);
+
+// DHCP client, driven by the scripted server in lease_test.c
+#define DHCP_STATE_OFF       0
+#define DHCP_STATE_REQUESTING 1
+#define DHCP_STATE_INIT      2
+#define DHCP_STATE_REBOOTING 3
+#define DHCP_STATE_SELECTING 6
+#define DHCP_STATE_BOUND     10
+
+struct dhcp {
+  uint8_t state;
+  ip4_addr_t offered_ip_addr;
+  ip4_addr_t offered_sn_mask;
+  ip4_addr_t offered_gw_addr;
+};
+
+// netif
+struct netif;
+typedef err_t (*netif_input_fn)(struct pbuf *p, struct netif *netif);
+
+struct netif {
+  ip4_addr_t ip_addr;
+  ip4_addr_t netmask;
+  ip4_addr_t gw;
+  uint8_t hwaddr[6];
+  bool link_up;
+  netif_input_fn input;
+  struct dhcp *dhcp;
+};
+
+#define netif_ip4_addr(n)    ((const ip4_addr_t *)&(n)->ip_addr)
+#define netif_ip4_netmask(n) ((const ip4_addr_t *)&(n)->netmask)
+#define netif_ip4_gw(n)      ((const ip4_addr_t *)&(n)->gw)
+#define netif_is_link_up(n)  ((n)->link_up)
+#define netif_dhcp_data(n)   ((n)->dhcp)
+
+err_t dhcp_start(struct netif *netif);
+uint8_t dhcp_supplied_address(const struct netif *netif);
+
+int etharp_get_entry(size_t i, ip4_addr_t **ipaddr, struct netif **netif,
+		     struct eth_addr **eth_ret);
+
+// Timers, on a simulated clock
+typedef void (*sys_timeout_handler)(void *arg);
+void sys_timeout(uint32_t msecs, sys_timeout_handler handler, void *arg);
+
+#endif
@@ -0,0 +1,2 @@
+// Host stand-in, see lease_host.h
+#include "lease_host.h"
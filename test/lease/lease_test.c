@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2025 Rob Scott
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Host test for rmii_ethernet_lease.c
+// The lease code runs against a fake flash sector, a fake ARP table and a
+// DHCP client stand-in whose server answers an INIT-REBOOT REQUEST with an
+// ACK, a NAK or nothing, as each test scripts it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../src/rmii_ethernet_lease.c"
+
+#define IP(a, b, c, d) ((uint32_t)(a) | ((b) << 8) | ((c) << 16) | \
+			((uint32_t)(d) << 24))
+
+static int failures = 0;
+
+#define CHECK(cond) do {						\
+    if (!(cond)) {							\
+      printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);		\
+      failures++;							\
+    }									\
+  } while (0)
+
+// Fake flash sector, erased to 0xff
+static uint8_t flash[FLASH_PAGE_SIZE];
+static uint flash_writes;
+
+static void lease_flash_read(lease_record_t *r) {
+  memcpy(r, flash, sizeof(*r));
+}
+
+static bool lease_flash_write(const lease_record_t *r) {
+  memset(flash, 0xff, sizeof(flash));
+  memcpy(flash, r, sizeof(*r));
+  flash_writes++;
+
+  return true;
+}
+
+// Simulated clock and sys_timeout()
+#define NUM_TIMER 8
+
+static struct {
+  uint32_t when;
+  sys_timeout_handler fn;
+  void *arg;
+} timers[NUM_TIMER];
+
+static uint32_t now;
+
+void sys_timeout(uint32_t msecs, sys_timeout_handler fn, void *arg) {
+  for (uint i = 0; i < NUM_TIMER; i++) {
+    if (timers[i].fn == NULL) {
+      timers[i].when = now + msecs;
+      timers[i].fn = fn;
+      timers[i].arg = arg;
+      return;
+    }
+  }
+
+  printf("  out of timers\n");
+  exit(1);
+}
+
+static void run_for(uint32_t ms) {
+  uint32_t end = now + ms;
+
+  for (; now <= end; now++) {
+    for (uint i = 0; i < NUM_TIMER; i++) {
+      if ((timers[i].fn != NULL) && (timers[i].when <= now)) {
+	sys_timeout_handler fn = timers[i].fn;
+	timers[i].fn = NULL;
+	fn(timers[i].arg);
+      }
+    }
+  }
+}
+
+// pbufs
+struct pbuf *pbuf_alloc(pbuf_layer layer, uint16_t len, pbuf_type type) {
+  struct pbuf *p = malloc(sizeof(*p) + len);
+
+  p->next = NULL;
+  p->payload = p + 1;
+  p->tot_len = len;
+  p->len = len;
+
+  return p;
+}
+
+uint8_t pbuf_free(struct pbuf *p) {
+  free(p);
+
+  return 1;
+}
+
+// ARP table the lease is built from
+typedef struct {
+  ip4_addr_t ip;
+  struct eth_addr mac;
+} arp_entry_t;
+
+static arp_entry_t arp_table[ARP_TABLE_SIZE];
+static uint arp_count;
+static struct netif netif;
+
+int etharp_get_entry(size_t i, ip4_addr_t **ipaddr, struct netif **n,
+		     struct eth_addr **eth_ret) {
+  if (i >= arp_count) return 0;
+
+  *ipaddr = &arp_table[i].ip;
+  *n = &netif;
+  *eth_ret = &arp_table[i].mac;
+
+  return 1;
+}
+
+static void arp_add(uint32_t ip, uint8_t id) {
+  arp_table[arp_count].ip.addr = ip;
+  memset(arp_table[arp_count].mac.addr, id, 6);
+  arp_count++;
+}
+
+// ARP replies fed to the stack by lease_arp_load()
+static arp_entry_t loaded[ARP_TABLE_SIZE];
+static uint loaded_count;
+
+static err_t netif_input(struct pbuf *p, struct netif *n) {
+  uint8_t *f = (uint8_t *)p->payload + ETH_PAD_SIZE;
+
+  // ARP reply to us
+  CHECK((f[12] == 0x08) && (f[13] == 0x06));
+  CHECK((f[20] == 0x00) && (f[21] == 0x02));
+  CHECK(memcmp(&f[0], n->hwaddr, 6) == 0);
+  CHECK(memcmp(&f[32], n->hwaddr, 6) == 0);
+
+  memcpy(&loaded[loaded_count].mac, &f[22], 6);
+  memcpy(&loaded[loaded_count].ip, &f[28], 4);
+  loaded_count++;
+
+  pbuf_free(p);
+
+  return ERR_OK;
+}
+
+// DHCP client stand-in and the scripted server
+typedef enum {
+  SERVER_ACK,     // ACK the INIT-REBOOT REQUEST
+  SERVER_NAK,     // NAK it, then offer the server's lease
+  SERVER_SILENT   // Ignore it, the client times out and DISCOVERs
+} server_reply_t;
+
+static struct dhcp dhcp;
+static server_reply_t server_reply;
+static ip4_addr_t server_ip, server_mask, server_gw;
+static uint reboot_requests;
+static uint discovers;
+
+err_t dhcp_start(struct netif *n) {
+  memset(&dhcp, 0, sizeof(dhcp));
+  dhcp.state = DHCP_STATE_INIT;
+  n->dhcp = &dhcp;
+
+  return ERR_OK;
+}
+
+uint8_t dhcp_supplied_address(const struct netif *n) {
+  return (n->dhcp != NULL) && (n->dhcp->state == DHCP_STATE_BOUND);
+}
+
+static void dhcp_bind(ip4_addr_t ip, ip4_addr_t mask, ip4_addr_t gw) {
+  netif.ip_addr = ip;
+  netif.netmask = mask;
+  netif.gw = gw;
+  dhcp.state = DHCP_STATE_BOUND;
+}
+
+static void dhcp_discover() {
+  discovers++;
+  dhcp.state = DHCP_STATE_SELECTING;
+  dhcp_bind(server_ip, server_mask, server_gw);
+}
+
+// As LWIP's dhcp_network_changed() on link up
+static void link_up() {
+  netif.link_up = true;
+
+  if (dhcp.state != DHCP_STATE_REBOOTING) {
+    dhcp_discover();
+    return;
+  }
+
+  reboot_requests++;
+
+  switch (server_reply) {
+  case SERVER_ACK:
+    dhcp_bind(dhcp.offered_ip_addr, dhcp.offered_sn_mask,
+	      dhcp.offered_gw_addr);
+    break;
+  case SERVER_NAK:
+    dhcp_discover();
+    break;
+  case SERVER_SILENT:
+    run_for(2000);
+    dhcp_discover();
+    break;
+  }
+}
+
+// Power on: clear everything but the flash
+static void boot() {
+  static const uint8_t mac[6] = { 0x02, 0x00, 0x00, 0x12, 0x34, 0x56 };
+
+  memset(&netif, 0, sizeof(netif));
+  memcpy(netif.hwaddr, mac, 6);
+  netif.input = netif_input;
+  memset(timers, 0, sizeof(timers));
+  memset(&lease, 0, sizeof(lease));
+  lease_resumed = false;
+  arp_count = 0;
+  loaded_count = 0;
+  reboot_requests = 0;
+  discovers = 0;
+  flash_writes = 0;
+  now = 0;
+
+  server_ip.addr = IP(192, 168, 1, 50);
+  server_mask.addr = IP(255, 255, 255, 0);
+  server_gw.addr = IP(192, 168, 1, 1);
+  server_reply = SERVER_ACK;
+}
+
+// Boot with an erased flash, bind, learn some peers and save the lease
+static void first_boot() {
+  memset(flash, 0xff, sizeof(flash));
+  boot();
+
+  netif_rmii_ethernet_dhcp_resume(&netif);
+  link_up();
+  arp_add(IP(192, 168, 1, 20), 0x20);
+  arp_add(IP(192, 168, 1, 1), 0x01);
+  arp_add(IP(192, 168, 1, 30), 0x30);
+  run_for(LEASE_SAVE_DELAY_MS + 100);
+}
+
+static void test_cold_boot() {
+  lease_record_t r;
+
+  printf("cold boot\n");
+  first_boot();
+
+  CHECK(reboot_requests == 0);
+  CHECK(discovers == 1);
+  CHECK(loaded_count == 0);
+  CHECK(flash_writes == 1);
+
+  lease_flash_read(&r);
+  CHECK(lease_valid(&r, &netif));
+  CHECK(r.ip.addr == IP(192, 168, 1, 50));
+  CHECK(r.gw.addr == IP(192, 168, 1, 1));
+  CHECK(r.num_arp == 3);
+  CHECK(r.arp[0].ip.addr == IP(192, 168, 1, 1));
+  CHECK(r.arp[0].mac.addr[0] == 0x01);
+
+  // Nothing changed, flash is spared
+  netif_rmii_ethernet_lease_save(&netif);
+  CHECK(flash_writes == 1);
+}
+
+static void test_reboot_ack() {
+  printf("reboot, ACK\n");
+  first_boot();
+  boot();
+
+  netif_rmii_ethernet_dhcp_resume(&netif);
+  CHECK(lease_resumed);
+  CHECK(dhcp.state == DHCP_STATE_REBOOTING);
+  CHECK(dhcp.offered_ip_addr.addr == IP(192, 168, 1, 50));
+
+  link_up();
+  run_for(LEASE_POLL_MS * 2);
+
+  CHECK(reboot_requests == 1);
+  CHECK(discovers == 0);
+  CHECK(loaded_count == 3);
+  CHECK(loaded[0].ip.addr == IP(192, 168, 1, 1));
+  CHECK(loaded[0].mac.addr[0] == 0x01);
+  CHECK(loaded[1].ip.addr == IP(192, 168, 1, 20));
+  CHECK(loaded[2].ip.addr == IP(192, 168, 1, 30));
+}
+
+static void test_reboot_nak() {
+  printf("reboot, NAK\n");
+  first_boot();
+  boot();
+
+  // Another LAN on the same subnet, with a different address and gateway
+  server_reply = SERVER_NAK;
+  server_ip.addr = IP(192, 168, 1, 77);
+  server_gw.addr = IP(192, 168, 1, 254);
+
+  netif_rmii_ethernet_dhcp_resume(&netif);
+  link_up();
+  arp_add(IP(192, 168, 1, 254), 0xfe);
+  run_for(LEASE_SAVE_DELAY_MS + 100);
+
+  CHECK(reboot_requests == 1);
+  CHECK(discovers == 1);
+  CHECK(loaded_count == 0);
+
+  // The new lease replaces the old one
+  CHECK(flash_writes == 1);
+  CHECK(lease_valid((lease_record_t *)flash, &netif));
+  CHECK(((lease_record_t *)flash)->ip.addr == IP(192, 168, 1, 77));
+}
+
+static void test_reboot_nak_same_address() {
+  printf("reboot, NAK, same address behind another gateway\n");
+  first_boot();
+  boot();
+
+  server_reply = SERVER_NAK;
+  server_gw.addr = IP(192, 168, 1, 254);
+
+  netif_rmii_ethernet_dhcp_resume(&netif);
+  link_up();
+  run_for(LEASE_POLL_MS * 2);
+
+  CHECK(discovers == 1);
+  CHECK(loaded_count == 0);
+}
+
+static void test_reboot_timeout() {
+  printf("reboot, no answer\n");
+  first_boot();
+  boot();
+
+  server_reply = SERVER_SILENT;
+  server_ip.addr = IP(192, 168, 1, 60);
+
+  netif_rmii_ethernet_dhcp_resume(&netif);
+  link_up();
+  run_for(LEASE_POLL_MS * 2);
+
+  CHECK(reboot_requests == 1);
+  CHECK(discovers == 1);
+  CHECK(netif.ip_addr.addr == IP(192, 168, 1, 60));
+  CHECK(loaded_count == 0);
+}
+
+static void test_other_mac() {
+  printf("lease saved by another MAC\n");
+  first_boot();
+  boot();
+  netif.hwaddr[5]++;
+
+  netif_rmii_ethernet_dhcp_resume(&netif);
+  CHECK(!lease_resumed);
+  CHECK(dhcp.state == DHCP_STATE_INIT);
+
+  link_up();
+  run_for(LEASE_POLL_MS * 2);
+
+  CHECK(reboot_requests == 0);
+  CHECK(loaded_count == 0);
+}
+
+static void test_corrupt() {
+  printf("corrupt lease record\n");
+  first_boot();
+  flash[offsetof(lease_record_t, ip)] ^= 1;
+  boot();
+
+  netif_rmii_ethernet_dhcp_resume(&netif);
+  CHECK(!lease_resumed);
+  CHECK(dhcp.state == DHCP_STATE_INIT);
+}
+
+static void test_link_up_first() {
+  printf("link already up at resume\n");
+  first_boot();
+  boot();
+  netif.link_up = true;
+
+  // DHCP has started DISCOVER already, it is left alone
+  netif_rmii_ethernet_dhcp_resume(&netif);
+  dhcp.state = DHCP_STATE_SELECTING;
+  dhcp_discover();
+  run_for(LEASE_POLL_MS * 2);
+
+  CHECK(reboot_requests == 0);
+  CHECK(loaded_count == 3);
+}
+
+static void test_other_subnet_entry() {
+  lease_record_t *r = (lease_record_t *)flash;
+
+  printf("saved entry off the subnet\n");
+  first_boot();
+  r->arp[2].ip.addr = IP(10, 0, 0, 30);
+  r->crc = lease_crc(r);
+  boot();
+
+  netif_rmii_ethernet_dhcp_resume(&netif);
+  link_up();
+  run_for(LEASE_POLL_MS * 2);
+
+  CHECK(loaded_count == 2);
+}
+
+int main() {
+  test_cold_boot();
+  test_reboot_ack();
+  test_reboot_nak();
+  test_reboot_nak_same_address();
+  test_reboot_timeout();
+  test_other_mac();
+  test_corrupt();
+  test_link_up_first();
+  test_other_subnet_entry();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+
+  printf("all passed\n");
+  return 0;
+}
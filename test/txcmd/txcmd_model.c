@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2025 Rob Scott
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Model of the single channel TX command ring (USE_SINGLE_CHAN_DMA)
+// tx_ring_send(), tx_start_next() and the TX DMA completion ISR in
+// rmii_ethernet.c, step by step, with the DMA finishing a frame and the
+// ISR running between any two steps of the output routine. Received PAUSE
+// hold-off and tx_pause_frame_send() run at any point too. Every order is
+// explored, and each must send every frame once, in order, and never stall
+// with commands queued.
+//
+// tx_start_next() runs under tx_cmd_lock, so it is a single step here.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A small command ring, so the frames lap it
+#define TX_NUM_PTR 4
+#define TX_NUM_MASK (TX_NUM_PTR - 1)
+
+// Frames sent by the output routine, and the most queued at once. The TX
+// byte ring runs out of space before the command ring fills.
+#define NUM_FRAME 6
+#define MAX_QUEUED (TX_NUM_PTR - 2)
+
+// Command for frame n, a word count. Commands from an earlier lap of the
+// ring are still in the slots, the model starts with stale ones.
+#define CMD(n) (1 + (n))
+#define STALE 0x40
+
+#define PAUSE_FRAME 0x80
+
+// tx_ring_send() steps, after waiting for space
+enum { SEND_EOC, SEND_CMD, SEND_START, SEND_BUMP };
+
+// tx_pause_frame_send() steps
+enum { PF_IDLE, PF_WAIT, PF_STOPPED, PF_SENDING, PF_DONE };
+
+// Received PAUSE, tx_pause_start() then tx_pause_check()
+enum { RP_NONE, RP_PAUSED, RP_RESUMED };
+
+typedef struct {
+  // Driver state
+  uint8_t tx_pkt_ptr[TX_NUM_PTR];
+  uint8_t tx_curr_pkt_ptr;
+  uint8_t tx_cmd_rd;
+  bool tx_paused;
+  bool tx_pause_hold;
+
+  // Packet DMA channel, and its pending completion interrupt
+  bool busy;
+  uint8_t frame;
+  bool irq;
+
+  // Output routine progress
+  uint8_t queued;        // Frames tx_ring_send() has started on
+  uint8_t step;
+  uint8_t pf;
+  uint8_t rp;
+
+  uint8_t sent;          // Frames on the wire
+  bool pause_sent;
+} model_t;
+
+static uint64_t states;
+static uint64_t terminals;
+static int failures;
+
+// Visited states, open addressing on the whole struct
+#define VISITED_POW 20
+static model_t *visited;
+static bool *visited_used;
+
+static uint32_t model_hash(const model_t *m) {
+  const uint8_t *b = (const uint8_t *)m;
+  uint32_t h = 2166136261u;
+
+  for (size_t i = 0; i < sizeof(*m); i++) {
+    h = (h ^ b[i]) * 16777619u;
+  }
+
+  return h;
+}
+
+// Returns true if m was seen before, adds it otherwise
+static bool model_seen(const model_t *m) {
+  uint32_t i = model_hash(m) & ((1u << VISITED_POW) - 1);
+
+  while (visited_used[i]) {
+    if (memcmp(&visited[i], m, sizeof(*m)) == 0) return true;
+    i = (i + 1) & ((1u << VISITED_POW) - 1);
+  }
+
+  visited[i] = *m;
+  visited_used[i] = true;
+  states++;
+
+  return false;
+}
+
+static void fail(const model_t *m, const char *what) {
+  if (failures++ < 5) {
+    printf("  FAIL %s: %u queued, step %u, %u sent, rd %u, curr %u, "
+	   "ring %u %u %u %u\n", what, m->queued, m->step, m->sent,
+	   m->tx_cmd_rd, m->tx_curr_pkt_ptr, m->tx_pkt_ptr[0],
+	   m->tx_pkt_ptr[1], m->tx_pkt_ptr[2], m->tx_pkt_ptr[3]);
+  }
+}
+
+// tx_start_next()
+static void tx_start_next(model_t *m) {
+
+  if (m->tx_paused || m->tx_pause_hold) return;
+
+  if (!m->busy) {
+    uint8_t len = m->tx_pkt_ptr[m->tx_cmd_rd];
+
+    // Zero is end of commands
+    if (len != 0) {
+      m->tx_cmd_rd = (m->tx_cmd_rd + 1) & TX_NUM_MASK;
+
+      // Must be the oldest frame not yet sent
+      if (len != CMD(m->sent)) fail(m, "wrong command started");
+
+      m->busy = true;
+      m->frame = len;
+    }
+  }
+}
+
+static void explore(const model_t *m);
+
+static void next(const model_t *m) {
+  if (!model_seen(m)) explore(m);
+}
+
+static void explore(const model_t *m) {
+  bool any = false;
+  model_t n;
+
+  // The packet DMA finishes its frame, raising the interrupt
+  if (m->busy) {
+    n = *m;
+    n.busy = false;
+    n.irq = true;
+    if (n.frame == PAUSE_FRAME) {
+      n.pause_sent = true;
+    } else {
+      n.sent++;
+    }
+    next(&n);
+    any = true;
+  }
+
+  // netif_rmii_ethernet_tx_dma_isr()
+  if (m->irq) {
+    n = *m;
+    n.irq = false;
+    tx_start_next(&n);
+    next(&n);
+    any = true;
+  }
+
+  // tx_ring_send(), on the poll core, blocked while a PAUSE frame is out
+  if ((m->queued < NUM_FRAME) && ((m->pf == PF_IDLE) || (m->pf == PF_DONE))) {
+    n = *m;
+    switch (m->step) {
+    case SEND_EOC:
+      // Wait for space in the TX ring
+      if ((m->queued - m->sent) >= MAX_QUEUED) break;
+      n.tx_pkt_ptr[(m->tx_curr_pkt_ptr + 1) & TX_NUM_MASK] = 0;
+      n.step = SEND_CMD;
+      next(&n);
+      any = true;
+      break;
+
+    case SEND_CMD:
+      n.tx_pkt_ptr[m->tx_curr_pkt_ptr] = CMD(m->queued);
+      n.step = SEND_START;
+      next(&n);
+      any = true;
+      break;
+
+    case SEND_START:
+      tx_start_next(&n);
+      n.step = SEND_BUMP;
+      next(&n);
+      any = true;
+      break;
+
+    case SEND_BUMP:
+      n.tx_curr_pkt_ptr = (m->tx_curr_pkt_ptr + 1) & TX_NUM_MASK;
+      n.step = SEND_EOC;
+      n.queued++;
+      next(&n);
+      any = true;
+      break;
+    }
+  }
+
+  // tx_pause_frame_send(), once, between output routine calls
+  if (m->step == SEND_EOC) {
+    n = *m;
+    switch (m->pf) {
+    case PF_IDLE:
+      n.tx_pause_hold = true;
+      n.pf = PF_WAIT;
+      next(&n);
+      any = true;
+      break;
+
+    case PF_WAIT:
+      // Wait for the frame on the wire
+      if (m->busy) break;
+      n.pf = PF_STOPPED;
+      next(&n);
+      any = true;
+      break;
+
+    case PF_STOPPED:
+      // Send from the PAUSE buffer, nothing may have started meanwhile
+      if (m->busy) fail(m, "frame started while held");
+      n.busy = true;
+      n.frame = PAUSE_FRAME;
+      n.pf = PF_SENDING;
+      next(&n);
+      any = true;
+      break;
+
+    case PF_SENDING:
+      if (m->busy) break;
+      n.tx_pause_hold = false;
+      tx_start_next(&n);
+      n.pf = PF_DONE;
+      next(&n);
+      any = true;
+      break;
+    }
+  }
+
+  // A received PAUSE holds off the ring, tx_pause_check() resumes it
+  if (m->rp == RP_NONE) {
+    n = *m;
+    n.tx_paused = true;
+    n.rp = RP_PAUSED;
+    next(&n);
+    any = true;
+  } else if (m->rp == RP_PAUSED) {
+    n = *m;
+    n.tx_paused = false;
+    tx_start_next(&n);
+    n.rp = RP_RESUMED;
+    next(&n);
+    any = true;
+  }
+
+  // Nothing left to happen, everything must have gone out
+  if (!any) {
+    terminals++;
+    if ((m->queued != NUM_FRAME) || (m->sent != NUM_FRAME)) {
+      fail(m, "stalled with frames queued");
+    }
+    if (m->pf != PF_DONE) fail(m, "PAUSE frame not sent");
+  }
+}
+
+int main() {
+  model_t m;
+
+  visited = calloc(1u << VISITED_POW, sizeof(*visited));
+  visited_used = calloc(1u << VISITED_POW, sizeof(*visited_used));
+  if ((visited == NULL) || (visited_used == NULL)) return 1;
+
+  printf("single channel TX command ring\n");
+
+  // Start part way round the ring, with stale commands in every slot
+  // except the end of commands, where the last lap stopped
+  memset(&m, 0, sizeof(m));
+  for (uint32_t i = 0; i < TX_NUM_PTR; i++) {
+    m.tx_pkt_ptr[i] = STALE + i;
+  }
+  m.tx_curr_pkt_ptr = 2;
+  m.tx_cmd_rd = 2;
+  m.tx_pkt_ptr[2] = 0;
+
+  model_seen(&m);
+  explore(&m);
+
+  printf("  %llu states, %llu end states\n", (unsigned long long)states,
+	 (unsigned long long)terminals);
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+
+  printf("all passed\n");
+  return 0;
+}
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Rebuild a pcapng file from the "PCAPNG <base64>" lines printed by
+# netif_rmii_ethernet_capture_drain(). Other output in the log is skipped.
+#
+# Usage:
+#   pcapng_from_log.py [-o capture.pcapng] [log file or serial port]
+#
+# Reads stdin when no log is given. A serial port (e.g. /dev/ttyACM0) is
+# read until interrupted, flushing each block, so a live capture can be
+# watched with: wireshark -k -i <(pcapng_from_log.py /dev/ttyACM0)
+
+import argparse
+import base64
+import binascii
+import struct
+import sys
+
+PREFIX = b'PCAPNG '
+SHB_TYPE = 0x0a0d0d0a
+
+
+def blocks(stream):
+    for line in stream:
+        line = line.strip()
+        i = line.find(PREFIX)
+        if i < 0:
+            continue
+        try:
+            blk = base64.b64decode(line[i + len(PREFIX):], validate=True)
+        except binascii.Error:
+            print('skipping garbled line', file=sys.stderr)
+            continue
+        if len(blk) < 12 or len(blk) % 4:
+            print('skipping short block', file=sys.stderr)
+            continue
+        btype, blen = struct.unpack_from('<II', blk)
+        if blen != len(blk) or struct.unpack_from('<I', blk, blen - 4)[0] != blen:
+            print('skipping damaged block', file=sys.stderr)
+            continue
+        yield btype, blk
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description='Rebuild a pcapng file from a driver capture log')
+    ap.add_argument('log', nargs='?', help='log file or serial port')
+    ap.add_argument('-o', '--output', default='-', help='pcapng file')
+    args = ap.parse_args()
+
+    src = open(args.log, 'rb') if args.log else sys.stdin.buffer
+    dst = open(args.output, 'wb') if args.output != '-' else sys.stdout.buffer
+
+    # Packet blocks are only valid after a section and interface header
+    in_section = False
+    packets = 0
+
+    try:
+        for btype, blk in blocks(src):
+            if btype == SHB_TYPE:
+                in_section = True
+            elif not in_section:
+                continue
+            dst.write(blk)
+            dst.flush()
+            if btype == 6:
+                packets += 1
+    except KeyboardInterrupt:
+        pass
+
+    print(f'{packets} packets', file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()